@@ -0,0 +1,267 @@
+#include "parent_ops.h"
+#include "output_relay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define DEFAULT_CHILDREN 16
+#define DEFAULT_SECONDS 10
+#define LATENCY_LOG_CAPACITY (1 << 20)
+#define MAX_SCRIPT_STEPS 256
+#define SCRIPT_COMMAND_LENGTH 16
+
+typedef struct script_step_s {
+    long at_ms;
+    char command[SCRIPT_COMMAND_LENGTH];
+} script_step_t;
+
+typedef struct child_totals_s {
+    size_t children;
+    size_t requests;
+    size_t reports;
+    size_t retries;
+} child_totals_t;
+
+static child_totals_t totals = {0, 0, 0, 0};
+static long long* round_trips = NULL;
+static size_t round_trip_count = 0;
+
+/*
+ * Swallows all child output. Stats records carry the child's own
+ * request-to-grant round trip (both signal hops), the final "totals"
+ * records the signal counts.
+ */
+static bool collect_totals(const process_info_t* child, const char* record, size_t len)
+{
+    char line[REPORT_LENGTH + 1];
+    size_t requests, reports, retries;
+    long long round_trip;
+
+    (void)child;
+    memcpy(line, record, len);
+    line[len] = '\0';
+
+    const char* g = strstr(line, "grant_ns=");
+    if (g && sscanf(g, "grant_ns=%lld", &round_trip) == 1 && round_trip >= 0 &&
+        round_trip_count < LATENCY_LOG_CAPACITY) {
+        round_trips[round_trip_count++] = round_trip;
+    }
+
+    const char* p = strstr(line, "totals:");
+    if (p && sscanf(p, "totals: requests=%zu reports=%zu retries=%zu",
+                    &requests, &reports, &retries) == 3) {
+        totals.children++;
+        totals.requests += requests;
+        totals.reports += reports;
+        totals.retries += retries;
+    }
+    return true;
+}
+
+/* Script format: "<ms>:<command>;<ms>:<command>...", e.g. "1000:s;1500:g;2000:p1". */
+static size_t parse_script(const char* spec, script_step_t* steps)
+{
+    size_t count = 0;
+
+    while (spec && *spec && count < MAX_SCRIPT_STEPS) {
+        char* end;
+        long at = strtol(spec, &end, 10);
+        if (end == spec || *end != ':') {
+            fprintf(stderr, "Bad script step: %s\n", spec);
+            exit(EXIT_FAILURE);
+        }
+
+        const char* command = end + 1;
+        size_t len = strcspn(command, ";");
+        if (len == 0 || len >= SCRIPT_COMMAND_LENGTH) {
+            fprintf(stderr, "Bad script command: %s\n", command);
+            exit(EXIT_FAILURE);
+        }
+
+        steps[count].at_ms = at;
+        memcpy(steps[count].command, command, len);
+        steps[count].command[len] = '\0';
+        count++;
+
+        spec = command[len] == ';' ? command + len + 1 : NULL;
+    }
+    return count;
+}
+
+static long long elapsed_ms(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)(now.tv_sec - start->tv_sec) * 1000 +
+           (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static int compare_latency(const void* a, const void* b)
+{
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const long long* sorted, size_t count, double p)
+{
+    if (count == 0) {
+        return 0.0;
+    }
+    size_t index = (size_t)(p * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1e3;
+}
+
+static size_t saturating_diff(size_t sent, size_t seen)
+{
+    return sent > seen ? sent - seen : 0;
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+            "Usage: %s [-n children] [-t seconds] [-f rate_hz] [-k samples_per_report]\n"
+            "          [-c grants] [-r grants_per_sec] [-b burst]\n"
+            "          [-x \"ms:cmd;ms:cmd...\"] [-o results.csv] [-l label]\n",
+            program);
+}
+
+int main(int argc, char* argv[])
+{
+    scheduler_config_t config = {1, 0.0, 1.0};
+    size_t children = DEFAULT_CHILDREN;
+    unsigned int seconds = DEFAULT_SECONDS;
+    char* sample_rate = "100";
+    char* samples_per_report = "10";
+    const char* script_spec = NULL;
+    const char* csv_path = "bench_results.csv";
+    const char* label = "sigusr";
+    script_step_t steps[MAX_SCRIPT_STEPS];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:f:k:c:r:b:x:o:l:")) != -1) {
+        switch (opt) {
+            case 'n': children = strtoul(optarg, NULL, 10); break;
+            case 't': seconds = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'f': sample_rate = optarg; break;
+            case 'k': samples_per_report = optarg; break;
+            case 'c': config.max_concurrent = strtoul(optarg, NULL, 10); break;
+            case 'r': config.rate = strtod(optarg, NULL); break;
+            case 'b': config.burst = strtod(optarg, NULL); break;
+            case 'x': script_spec = optarg; break;
+            case 'o': csv_path = optarg; break;
+            case 'l': label = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t step_count = parse_script(script_spec, steps);
+    long long* latencies = (long long*)malloc(LATENCY_LOG_CAPACITY * sizeof(long long));
+    round_trips = (long long*)malloc(LATENCY_LOG_CAPACITY * sizeof(long long));
+    if (!latencies || !round_trips) {
+        perror("Failed to allocate latency log");
+        return EXIT_FAILURE;
+    }
+
+    init_parent(&config);
+    quiet_mode = true;
+    relay_set_hook(collect_totals);
+    set_child_arguments(sample_rate, samples_per_report);
+    scheduler_log_latencies(latencies, LATENCY_LOG_CAPACITY);
+
+    for (size_t i = 0; i < children; i++) {
+        if (!spawn_child_process()) {
+            break;
+        }
+    }
+    size_t spawned = num_child_processes;
+
+    struct timespec start;
+    int signals_before = requests_seen + reports_seen;
+    size_t next_step = 0;
+    long long now_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((now_ms = elapsed_ms(&start)) < (long long)seconds * 1000) {
+        while (next_step < step_count && steps[next_step].at_ms <= now_ms) {
+            handle_user_command(steps[next_step++].command);
+        }
+
+        long long wake = (long long)seconds * 1000;
+        if (next_step < step_count && steps[next_step].at_ms < wake) {
+            wake = steps[next_step].at_ms;
+        }
+        relay_poll((int)(wake - now_ms) + 1);
+    }
+    double duration = (double)elapsed_ms(&start) / 1e3;
+    int signals_in_window = requests_seen + reports_seen - signals_before;
+
+    /* Children print their totals on SIGTERM; the relay hook collects them. */
+    terminate_all_children();
+
+    size_t logged = scheduler_logged_latencies();
+    qsort(latencies, logged, sizeof(long long), compare_latency);
+    qsort(round_trips, round_trip_count, sizeof(long long), compare_latency);
+
+    size_t seen_requests = (size_t)requests_seen;
+    size_t seen_reports = (size_t)reports_seen;
+    size_t lost_requests = saturating_diff(totals.requests, seen_requests);
+    size_t lost_completions = saturating_diff(totals.reports, seen_reports);
+    double signals_per_sec = (double)signals_in_window / duration;
+
+    printf(SEPARATE);
+    printf("Transport: %s, children: %zu (totals from %zu)\n", label, spawned, totals.children);
+    printf("Signals/s: %.1f, grants: %zu, reports with a round trip: %zu\n",
+           signals_per_sec, logged, round_trip_count);
+    printf("Request-to-grant round trip us (child): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+           percentile_us(round_trips, round_trip_count, 0.50),
+           percentile_us(round_trips, round_trip_count, 0.90),
+           percentile_us(round_trips, round_trip_count, 0.99),
+           percentile_us(round_trips, round_trip_count, 1.0));
+    printf("Of that, queued in P us: p50 %.1f, p99 %.1f, max %.1f\n",
+           percentile_us(latencies, logged, 0.50), percentile_us(latencies, logged, 0.99),
+           percentile_us(latencies, logged, 1.0));
+    printf("Requests sent/seen: %zu/%zu (lost %zu), completions sent/seen: %zu/%zu (lost %zu)\n",
+           totals.requests, seen_requests, lost_requests,
+           totals.reports, seen_reports, lost_completions);
+    printf("Child retries: %zu, reclaimed grants: %zu, implicit completions: %zu\n",
+           totals.retries, scheduler_reclaimed(), scheduler_implicit_completions());
+    printf(SEPARATE);
+
+    FILE* csv = fopen(csv_path, "a");
+    if (!csv) {
+        perror("Failed to open CSV file");
+    } else {
+        if (ftell(csv) == 0) {
+            fprintf(csv, "label,children,sample_rate_hz,samples_per_report,max_concurrent,"
+                         "grant_rate,duration_s,signals_per_s,grants,lat_p50_us,lat_p90_us,"
+                         "lat_p99_us,lat_max_us,queue_p50_us,queue_p99_us,requests_sent,requests_seen,"
+                         "lost_requests,reports_sent,reports_seen,lost_completions,retries,"
+                         "reclaimed,unknown\n");
+        }
+        fprintf(csv, "%s,%zu,%s,%s,%zu,%.1f,%.3f,%.1f,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,"
+                     "%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%d\n",
+                label, spawned, sample_rate, samples_per_report, config.max_concurrent,
+                config.rate, duration, signals_per_sec, logged,
+                percentile_us(round_trips, round_trip_count, 0.50),
+                percentile_us(round_trips, round_trip_count, 0.90),
+                percentile_us(round_trips, round_trip_count, 0.99),
+                percentile_us(round_trips, round_trip_count, 1.0),
+                percentile_us(latencies, logged, 0.50), percentile_us(latencies, logged, 0.99),
+                totals.requests, seen_requests, lost_requests,
+                totals.reports, seen_reports, lost_completions,
+                totals.retries, scheduler_reclaimed(), (int)unknown_signals);
+        fclose(csv);
+        printf("Results appended to %s\n", csv_path);
+    }
+
+    scheduler_log_latencies(NULL, 0);
+    free(latencies);
+    free(round_trips);
+    cleanup_parent();
+    return EXIT_SUCCESS;
+}
@@ -3,10 +3,7 @@
 
 int main(int argc, char* argv[])
 {
-    (void)argc; 
-    (void)argv;   
-
-    init_child();     
+    init_child(argc, argv);
     run_child_process(); 
 
     return EXIT_SUCCESS; 
@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200112L
 #include "child_ops.h"
 #include <stdio.h>
 #include <unistd.h>
@@ -7,9 +7,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/stat.h>
 
-#define STATS_UPDATE_INTERVAL_NS 100000000
-#define STATS_OUTPUT_FREQUENCY 101
+#define NSEC_PER_SEC 1000000000L
+#define DEFAULT_SAMPLE_RATE_HZ 10
+#define MAX_SAMPLE_RATE_HZ 100000
+#define DEFAULT_SAMPLES_PER_REPORT 101
+#define GRANT_RETRY_NS NSEC_PER_SEC
+#define JITTER_BUCKETS 18
 
 pair_t stats = {0, 0};
 size_t c00 = 0, c01 = 0, c10 = 0, c11 = 0;
@@ -17,6 +22,22 @@ size_t iteration_count = 0;
 char child_name[CHILD_NAME_LENGTH] = {0};
 volatile sig_atomic_t alarm_received = false;
 volatile sig_atomic_t output_permission_state = WAITING;
+volatile sig_atomic_t terminate_requested = false;
+
+static int report_fd = STDOUT_FILENO;
+static long sample_period_ns = NSEC_PER_SEC / DEFAULT_SAMPLE_RATE_HZ;
+static size_t samples_per_report = DEFAULT_SAMPLES_PER_REPORT;
+static size_t missed_samples = 0;
+static size_t grant_retries = 0;
+static size_t requests_sent = 0;
+static size_t reports_sent = 0;
+static size_t total_retries = 0;
+/* First request of a report to the grant's arrival, retries included. */
+static struct timespec requested_at;
+static struct timespec granted_at;
+static long long grant_round_trip_ns = -1;
+/* Bucket 0 counts wakeups less than 1 us late, bucket b those in [2^(b-1), 2^b) us. */
+static size_t jitter_histogram[JITTER_BUCKETS];
 
 void handle_child_signals(int sig)
 {
@@ -25,11 +46,15 @@ void handle_child_signals(int sig)
             alarm_received = true;
             break;
         case SIGUSR1:
+            clock_gettime(CLOCK_MONOTONIC, &granted_at);
             output_permission_state = PRINT_ALLOWED;
             break;
         case SIGUSR2:
             output_permission_state = PRINT_FORBIDDEN;
             break;
+        case SIGTERM:
+            terminate_requested = true;
+            break;
     }
 }
 
@@ -55,33 +80,96 @@ void cycle_pair_values(void)
     cycle_pos = (cycle_pos + 1) % 4;
 }
 
+static void timespec_add_ns(struct timespec* ts, long ns)
+{
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= NSEC_PER_SEC) {
+        ts->tv_nsec -= NSEC_PER_SEC;
+        ts->tv_sec++;
+    }
+}
+
+static long long timespec_diff_ns(const struct timespec* later, const struct timespec* earlier)
+{
+    return (long long)(later->tv_sec - earlier->tv_sec) * NSEC_PER_SEC +
+           (later->tv_nsec - earlier->tv_nsec);
+}
+
+static void record_jitter(long long late_ns)
+{
+    long long us = late_ns / 1000;
+    size_t bucket = 0;
+
+    while (us > 0 && bucket < JITTER_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    jitter_histogram[bucket]++;
+}
+
+static int format_jitter_histogram(char* buffer, size_t size)
+{
+    int used = snprintf(buffer, size, " missed=%zu retries=%zu grant_ns=%lld jitter_us:",
+                        missed_samples, grant_retries, grant_round_trip_ns);
+
+    for (size_t b = 0; b < JITTER_BUCKETS && used > 0 && (size_t)used < size; b++) {
+        if (jitter_histogram[b] == 0) {
+            continue;
+        }
+        const char* op = b == JITTER_BUCKETS - 1 ? ">=" : "<";
+        unsigned long bound = b == JITTER_BUCKETS - 1 ? 1UL << (b - 1) : 1UL << b;
+        int len = snprintf(buffer + used, size - (size_t)used, " %s%lu:%zu", op, bound, jitter_histogram[b]);
+        if (len < 0) {
+            return len;
+        }
+        used += len;
+    }
+    return used;
+}
+
+/* A whole record goes out in one write(), which a pipe keeps atomic. */
 void print_safe(const char* str) {
-    for (; *str; str++) {
-        if (putchar(*str) == EOF) {
+    size_t len = strlen(str);
+
+    while (len > 0) {
+        ssize_t n = write(report_fd, str, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
             if (errno == EPIPE) {
-                _exit(EXIT_FAILURE); 
+                _exit(EXIT_FAILURE);
             }
-            perror("putchar failed");
-            break;
+            perror("write failed");
+            return;
         }
-    }
-    if (fflush(stdout) == EOF) {
-        perror("fflush failed");
+        str += n;
+        len -= (size_t)n;
     }
 }
 
 void output_stats_report(void)
 {
-    char buffer[256];
+    char buffer[REPORT_LENGTH];
     int len = snprintf(buffer, sizeof(buffer),
-                       "[%s pid: %d ppid: %d] stats: 00=%zu 01=%zu 10=%zu 11=%zu\n",
+                       "[%s pid: %d ppid: %d] stats: 00=%zu 01=%zu 10=%zu 11=%zu",
                        child_name, getpid(), getppid(), c00, c01, c10, c11);
 
     if (len > 0 && len < (int)sizeof(buffer)) {
+        int extra = format_jitter_histogram(buffer + len, sizeof(buffer) - (size_t)len - 1);
+        if (extra >= 0 && len + extra < (int)sizeof(buffer) - 1) {
+            len += extra;
+        }
+        buffer[len] = '\n';
+        buffer[len + 1] = '\0';
         print_safe(buffer);
     }
 
     c00 = c01 = c10 = c11 = 0;
+    total_retries += grant_retries;
+    missed_samples = grant_retries = 0;
+    reports_sent++;
+    memset(jitter_histogram, 0, sizeof(jitter_histogram));
 
     if (kill(getppid(), SIGUSR2) == -1) {
         perror("failed to send SIGUSR2 to parent");
@@ -90,15 +178,60 @@ void output_stats_report(void)
 
 void ask_parent_for_output(void)
 {
+    output_permission_state = WAITING;
     if (kill(getppid(), SIGUSR1) == -1) {
         perror("failed to request output permission");
         return;
     }
-    output_permission_state = WAITING;
+    requests_sent++;
 }
 
-void init_child(void)
+/* Final record on SIGTERM, so a driver can compare signals sent and seen. */
+static void exit_with_totals(void)
 {
+    char buffer[REPORT_LENGTH];
+    int len = snprintf(buffer, sizeof(buffer),
+                       "[%s pid: %d ppid: %d] totals: requests=%zu reports=%zu retries=%zu\n",
+                       child_name, getpid(), getppid(), requests_sent, reports_sent,
+                       total_retries + grant_retries);
+
+    if (len > 0 && len < (int)sizeof(buffer)) {
+        print_safe(buffer);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+static void parse_child_arguments(int argc, char* argv[])
+{
+    if (argc > 1) {
+        long rate = strtol(argv[1], NULL, 10);
+        if (rate <= 0 || rate > MAX_SAMPLE_RATE_HZ) {
+            fprintf(stderr, "sample rate must be in 1..%d Hz\n", MAX_SAMPLE_RATE_HZ);
+            _exit(EXIT_FAILURE);
+        }
+        sample_period_ns = NSEC_PER_SEC / rate;
+    }
+
+    if (argc > 2) {
+        long samples = strtol(argv[2], NULL, 10);
+        if (samples <= 0) {
+            fprintf(stderr, "samples per report must be positive\n");
+            _exit(EXIT_FAILURE);
+        }
+        samples_per_report = (size_t)samples;
+    }
+}
+
+void init_child(int argc, char* argv[])
+{
+    parse_child_arguments(argc, argv);
+
+    /* Started by the parent: reports go to the private pipe on REPORT_FD. */
+    struct stat st;
+    if (fstat(REPORT_FD, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        report_fd = REPORT_FD;
+    }
+
     if (snprintf(child_name, CHILD_NAME_LENGTH, "child_%d", getpid()) < 0) {
         perror("failed to create child name");
         _exit(EXIT_FAILURE);
@@ -111,45 +244,96 @@ void init_child(void)
 
     if (sigaction(SIGALRM, &sa, NULL) == -1 ||
         sigaction(SIGUSR1, &sa, NULL) == -1 ||
-        sigaction(SIGUSR2, &sa, NULL) == -1) {
+        sigaction(SIGUSR2, &sa, NULL) == -1 ||
+        sigaction(SIGTERM, &sa, NULL) == -1) {
         perror("failed to set signal handlers");
         _exit(EXIT_FAILURE);
     }
 }
 
+/*
+ * Waits for the parent's answer. A request lost to signal coalescing is
+ * repeated after GRANT_RETRY_NS instead of leaving the child stuck in pause().
+ */
+static void wait_for_permission(void)
+{
+    struct timespec retry_at;
+    clock_gettime(CLOCK_MONOTONIC, &retry_at);
+    timespec_add_ns(&retry_at, GRANT_RETRY_NS);
+
+    while (output_permission_state == WAITING && !terminate_requested) {
+        int rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &retry_at, NULL);
+        if (rc == 0 && output_permission_state == WAITING) {
+            grant_retries++;
+            ask_parent_for_output();
+            timespec_add_ns(&retry_at, GRANT_RETRY_NS);
+        } else if (rc != 0 && rc != EINTR) {
+            errno = rc;
+            perror("clock_nanosleep failed");
+            return;
+        }
+    }
+}
+
+/*
+ * Samples on an absolute schedule: deadlines advance by exactly one period,
+ * so time spent sampling or in a signal handler does not accumulate as drift.
+ */
 void run_child_process(void) {
-    const struct timespec interval = {0, STATS_UPDATE_INTERVAL_NS};
+    struct timespec deadline, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    timespec_add_ns(&deadline, sample_period_ns);
 
     while (1) {
+        if (terminate_requested) {
+            exit_with_totals();
+        }
+
         if (getppid() == 1) {
             print_safe("Parent process died, exiting...\n");
             _exit(EXIT_FAILURE);
         }
 
-        if (nanosleep(&interval, NULL) == -1) {
-            if (errno != EINTR) {
-                perror("nanosleep failed");
-                break;
-            }
+        int rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        if (rc == EINTR) {
             continue;
         }
+        if (rc != 0) {
+            errno = rc;
+            perror("clock_nanosleep failed");
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long late_ns = timespec_diff_ns(&now, &deadline);
+        record_jitter(late_ns);
 
         cycle_pair_values();
         update_pair_stats();
         iteration_count++;
 
-        if (iteration_count % STATS_OUTPUT_FREQUENCY == 0) {
-            ask_parent_for_output();
+        timespec_add_ns(&deadline, sample_period_ns);
+        if (late_ns >= sample_period_ns) {
+            long long skipped = late_ns / sample_period_ns;
+            missed_samples += (size_t)skipped;
+            timespec_add_ns(&deadline, (long)(skipped * sample_period_ns));
+        }
 
-            while (output_permission_state == WAITING) {
-                pause();
-            }
+        if (iteration_count % samples_per_report == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &requested_at);
+            ask_parent_for_output();
+            wait_for_permission();
 
             if (output_permission_state == PRINT_ALLOWED) {
+                grant_round_trip_ns = timespec_diff_ns(&granted_at, &requested_at);
                 output_stats_report();
             }
 
             output_permission_state = WAITING;
+
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            timespec_add_ns(&deadline, sample_period_ns);
         }
     }
 }
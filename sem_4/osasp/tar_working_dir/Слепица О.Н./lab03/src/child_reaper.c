@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+#include "child_reaper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#define EPOLL_BATCH 64
+#define FALLBACK_POLL_MS 10
+
+typedef struct reap_target_s {
+    pid_t pid;
+    int pidfd;
+    bool reaped;
+} reap_target_t;
+
+static int pidfd_open(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static long long monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* One pidfd per child; raise the soft descriptor limit up front if needed. */
+static void reserve_descriptors(size_t count)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < count + 64) {
+        limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > count + 64
+                         ? (rlim_t)(count + 64) : limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static bool try_reap(reap_target_t* target)
+{
+    pid_t rc = waitpid(target->pid, NULL, WNOHANG);
+    if (rc == 0) {
+        return false;
+    }
+    if (rc == -1 && errno != ECHILD) {
+        perror("Failed to wait for child");
+    }
+
+    target->reaped = true;
+    if (target->pidfd != -1) {
+        close(target->pidfd);
+        target->pidfd = -1;
+    }
+    return true;
+}
+
+/* Returns the number of targets still running when the deadline passes. */
+static size_t wait_all(int epfd, reap_target_t* targets, size_t count,
+                       size_t remaining, long long deadline_ms)
+{
+    struct epoll_event events[EPOLL_BATCH];
+
+    while (remaining > 0) {
+        bool polling = false;
+        for (size_t i = 0; i < count; i++) {
+            if (!targets[i].reaped && targets[i].pidfd == -1) {
+                remaining -= try_reap(&targets[i]);
+                polling = true;
+            }
+        }
+        if (remaining == 0) {
+            break;
+        }
+
+        long long timeout = -1;
+        if (deadline_ms >= 0) {
+            timeout = deadline_ms - monotonic_ms();
+            if (timeout <= 0) {
+                break;
+            }
+        }
+        if (polling && (timeout == -1 || timeout > FALLBACK_POLL_MS)) {
+            timeout = FALLBACK_POLL_MS;
+        }
+
+        int ready = epoll_wait(epfd, events, EPOLL_BATCH, (int)timeout);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            reap_target_t* target = &targets[events[i].data.u32];
+            if (!target->reaped && try_reap(target)) {
+                remaining--;
+            }
+        }
+    }
+    return remaining;
+}
+
+size_t terminate_children(const pid_t* pids, size_t count, long grace_ms)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    reap_target_t* targets = (reap_target_t*)malloc(count * sizeof(reap_target_t));
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (!targets || epfd == -1) {
+        perror("Failed to prepare parallel shutdown");
+        free(targets);
+        if (epfd != -1) {
+            close(epfd);
+        }
+        for (size_t i = 0; i < count; i++) {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+        return count;
+    }
+
+    reserve_descriptors(count);
+
+    for (size_t i = 0; i < count; i++) {
+        targets[i].pid = pids[i];
+        targets[i].reaped = false;
+        targets[i].pidfd = pidfd_open(pids[i]);
+
+        if (targets[i].pidfd != -1) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = (uint32_t)i;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, targets[i].pidfd, &ev) == -1) {
+                close(targets[i].pidfd);
+                targets[i].pidfd = -1;
+            }
+        }
+
+        if (kill(pids[i], SIGTERM) == -1 && errno != ESRCH) {
+            perror("Failed to send SIGTERM");
+        }
+    }
+
+    size_t stragglers = wait_all(epfd, targets, count, count, monotonic_ms() + grace_ms);
+
+    if (stragglers > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (!targets[i].reaped && kill(targets[i].pid, SIGKILL) == -1 && errno != ESRCH) {
+                perror("Failed to send SIGKILL");
+            }
+        }
+        wait_all(epfd, targets, count, stragglers, -1);
+    }
+
+    close(epfd);
+    free(targets);
+    return stragglers;
+}
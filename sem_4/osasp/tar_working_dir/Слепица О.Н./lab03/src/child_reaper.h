@@ -0,0 +1,13 @@
+#ifndef CHILD_REAPER_H
+#define CHILD_REAPER_H
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Sends SIGTERM to every pid first, then waits for all of them together on
+ * their pidfds. Children still alive after grace_ms get SIGKILL. Returns the
+ * number of children that had to be killed.
+ */
+size_t terminate_children(const pid_t* pids, size_t count, long grace_ms);
+
+#endif
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 199309L
+#include "child_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+
+#define EMPTY_ENTRY (-1)
+
+size_t num_child_processes = 0;
+size_t max_child_processes = 0;
+process_info_t* child_processes = NULL;
+
+static int* pid_index = NULL;
+static unsigned int index_bits = 0;
+static unsigned long long next_spawn_seq = 0;
+
+static size_t index_capacity(void)
+{
+    return (size_t)1 << index_bits;
+}
+
+static size_t pid_hash(pid_t pid)
+{
+    return (size_t)(((uint32_t)pid * 2654435761u) >> (32 - index_bits));
+}
+
+static size_t index_lookup(pid_t pid)
+{
+    size_t mask = index_capacity() - 1;
+
+    for (size_t i = pid_hash(pid); ; i = (i + 1) & mask) {
+        if (pid_index[i] == EMPTY_ENTRY ||
+            child_processes[pid_index[i]].pid == pid) {
+            return i;
+        }
+    }
+}
+
+static void index_rebuild(void)
+{
+    for (size_t i = 0; i < index_capacity(); i++) {
+        pid_index[i] = EMPTY_ENTRY;
+    }
+
+    for (size_t slot = 0; slot < num_child_processes; slot++) {
+        pid_index[index_lookup(child_processes[slot].pid)] = (int)slot;
+    }
+}
+
+static bool index_resize(unsigned int bits)
+{
+    int* table = (int*)malloc(((size_t)1 << bits) * sizeof(int));
+    if (!table) {
+        return false;
+    }
+
+    free(pid_index);
+    pid_index = table;
+    index_bits = bits;
+    index_rebuild();
+    return true;
+}
+
+/* Backward-shift deletion keeps probe chains intact without tombstones. */
+static void index_erase(size_t pos)
+{
+    size_t mask = index_capacity() - 1;
+    size_t hole = pos;
+
+    pid_index[hole] = EMPTY_ENTRY;
+    for (size_t i = (hole + 1) & mask; pid_index[i] != EMPTY_ENTRY; i = (i + 1) & mask) {
+        size_t home = pid_hash(child_processes[pid_index[i]].pid);
+        bool stays = (hole <= i) ? (hole < home && home <= i)
+                                 : (hole < home || home <= i);
+        if (!stays) {
+            pid_index[hole] = pid_index[i];
+            pid_index[i] = EMPTY_ENTRY;
+            hole = i;
+        }
+    }
+}
+
+void registry_init(void)
+{
+    max_child_processes = INITIAL_CHILD_CAPACITY;
+    num_child_processes = 0;
+    child_processes = (process_info_t*)calloc(max_child_processes, sizeof(process_info_t));
+    if (!child_processes || !index_resize(4)) {
+        perror("Failed to allocate memory for child processes");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void registry_free(void)
+{
+    free(child_processes);
+    free(pid_index);
+    child_processes = NULL;
+    pid_index = NULL;
+    num_child_processes = max_child_processes = 0;
+    index_bits = 0;
+}
+
+void registry_lock(sigset_t* saved)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    sigaddset(&set, SIGALRM);
+    sigaddset(&set, GRANT_TIMER_SIGNAL);
+    sigprocmask(SIG_BLOCK, &set, saved);
+}
+
+void registry_unlock(const sigset_t* saved)
+{
+    sigprocmask(SIG_SETMASK, saved, NULL);
+}
+
+process_info_t* registry_add(pid_t pid)
+{
+    if (num_child_processes == max_child_processes) {
+        size_t capacity = max_child_processes * 2;
+        process_info_t* slots = (process_info_t*)realloc(child_processes,
+                                                         capacity * sizeof(process_info_t));
+        if (!slots) {
+            return NULL;
+        }
+        child_processes = slots;
+        max_child_processes = capacity;
+    }
+
+    if ((num_child_processes + 1) * 2 > index_capacity() && !index_resize(index_bits + 1)) {
+        return NULL;
+    }
+
+    process_info_t* child = &child_processes[num_child_processes];
+    memset(child, 0, sizeof(*child));
+    child->pid = pid;
+    child->spawn_seq = ++next_spawn_seq;
+    child->output_fd = -1;
+    pid_index[index_lookup(pid)] = (int)num_child_processes;
+    num_child_processes++;
+    return child;
+}
+
+process_info_t* registry_find(pid_t pid)
+{
+    if (!pid_index) {
+        return NULL;
+    }
+
+    int slot = pid_index[index_lookup(pid)];
+    return slot == EMPTY_ENTRY ? NULL : &child_processes[slot];
+}
+
+bool registry_remove(pid_t pid)
+{
+    size_t pos = index_lookup(pid);
+    if (pid_index[pos] == EMPTY_ENTRY) {
+        return false;
+    }
+
+    size_t slot = (size_t)pid_index[pos];
+    size_t last = num_child_processes - 1;
+    index_erase(pos);
+
+    if (slot != last) {
+        child_processes[slot] = child_processes[last];
+        pid_index[index_lookup(child_processes[slot].pid)] = (int)slot;
+    }
+    num_child_processes--;
+    return true;
+}
+
+process_info_t* registry_newest(void)
+{
+    process_info_t* newest = NULL;
+
+    for (size_t slot = 0; slot < num_child_processes; slot++) {
+        if (!newest || child_processes[slot].spawn_seq > newest->spawn_seq) {
+            newest = &child_processes[slot];
+        }
+    }
+    return newest;
+}
+
+void registry_clear(void)
+{
+    num_child_processes = 0;
+    for (size_t i = 0; i < index_capacity(); i++) {
+        pid_index[i] = EMPTY_ENTRY;
+    }
+}
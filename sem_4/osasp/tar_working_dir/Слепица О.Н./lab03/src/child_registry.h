@@ -0,0 +1,25 @@
+#ifndef CHILD_REGISTRY_H
+#define CHILD_REGISTRY_H
+#include "globals.h"
+
+/*
+ * Growable table of children. Slots are kept dense in child_processes[0..n),
+ * an open-addressing index maps pid -> slot so the signal handler finds the
+ * sender in O(1); removal moves the last slot into the hole, so array order
+ * is not spawn order (spawn_seq is). Mutations must be done between
+ * registry_lock() and registry_unlock(), which keep the parent's signal
+ * handlers out.
+ */
+void registry_init(void);
+void registry_free(void);
+void registry_lock(sigset_t* saved);
+void registry_unlock(const sigset_t* saved);
+
+process_info_t* registry_add(pid_t pid);
+process_info_t* registry_find(pid_t pid);
+bool registry_remove(pid_t pid);
+/* The most recently spawned child still registered; a scan, for '-' only. */
+process_info_t* registry_newest(void);
+void registry_clear(void);
+
+#endif
@@ -6,14 +6,38 @@
 #include <stdio.h>
 #include <signal.h>
 
-#define MAX_CHILDREN 8
+#define INITIAL_CHILD_CAPACITY 8
 #define CHILD_NAME_LENGTH 16
 
+#define GRANT_TIMER_SIGNAL SIGRTMIN
+#define REPORT_FD 3
+#define REPORT_LENGTH 512
+#define PIPE_CHUNK_SIZE 4096
+
 #define SEPARATE "=============================================\n"
 
+typedef enum {
+    GRANT_IDLE,
+    GRANT_QUEUED,
+    GRANT_ACTIVE
+} grant_state_t;
+
 typedef struct process_info_s {
     pid_t pid;             
-    bool is_stopped;         
+    unsigned long long spawn_seq;       /* registry_add() order, the newest is highest */
+    volatile sig_atomic_t is_stopped;
+    volatile sig_atomic_t requests;     /* SIGUSR1 seen by the handler */
+    volatile sig_atomic_t reports;      /* SIGUSR2 seen by the handler */
+    volatile sig_atomic_t grant_state;
+    unsigned int weight;
+    unsigned long long virtual_finish;  /* fair-queueing tag of the last request */
+    long long requested_at_ns;
+    long long total_wait_ns;
+    long long max_wait_ns;
+    size_t grants;
+    int output_fd;                      /* read end of the child's report pipe */
+    size_t pending_len;
+    char pending[REPORT_LENGTH];        /* partial line read from output_fd */
     char name[CHILD_NAME_LENGTH];
 } process_info_t;
 
@@ -0,0 +1,387 @@
+#define _POSIX_C_SOURCE 199309L
+#include "grant_scheduler.h"
+#include "child_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#define STRIDE (1ULL << 20)
+#define GRANT_TIMEOUT_NS 2000000000LL
+
+typedef struct queue_entry_s {
+    unsigned long long tag;
+    unsigned long long seq;
+    pid_t pid;
+} queue_entry_t;
+
+typedef struct active_grant_s {
+    pid_t pid;
+    long long expires_ns;
+} active_grant_t;
+
+static scheduler_config_t config = {1, 0.0, 1.0};
+
+static queue_entry_t* heap = NULL;
+static size_t heap_size = 0;
+static size_t heap_capacity = 0;
+static unsigned long long next_seq = 0;
+static unsigned long long virtual_time = 0;
+
+static active_grant_t* active = NULL;
+static size_t active_count = 0;
+static size_t reclaimed_grants = 0;
+static size_t implicit_completions = 0;
+
+static long long* latency_log = NULL;
+static size_t latency_capacity = 0;
+static size_t latency_count = 0;
+
+static double tokens = 0.0;
+static long long refilled_at_ns = 0;
+
+static timer_t dispatch_timer;
+static bool timer_ready = false;
+
+static long long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool entry_before(const queue_entry_t* a, const queue_entry_t* b)
+{
+    return a->tag != b->tag ? a->tag < b->tag : a->seq < b->seq;
+}
+
+static void heap_swap(size_t i, size_t j)
+{
+    queue_entry_t tmp = heap[i];
+    heap[i] = heap[j];
+    heap[j] = tmp;
+}
+
+static void sift_up(size_t i)
+{
+    while (i > 0 && entry_before(&heap[i], &heap[(i - 1) / 2])) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(size_t i)
+{
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < heap_size && entry_before(&heap[left], &heap[smallest])) smallest = left;
+        if (right < heap_size && entry_before(&heap[right], &heap[smallest])) smallest = right;
+        if (smallest == i) return;
+
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_remove_at(size_t i)
+{
+    heap[i] = heap[--heap_size];
+    if (i < heap_size) {
+        sift_up(i);
+        sift_down(i);
+    }
+}
+
+static void release_active(pid_t pid)
+{
+    for (size_t i = 0; i < active_count; i++) {
+        if (active[i].pid == pid) {
+            active[i] = active[--active_count];
+            return;
+        }
+    }
+}
+
+/* A lost "finished" signal must not hold a grant forever. */
+static void reclaim_expired(long long now)
+{
+    for (size_t i = 0; i < active_count; ) {
+        if (active[i].expires_ns <= now) {
+            process_info_t* child = registry_find(active[i].pid);
+            if (child) {
+                child->grant_state = GRANT_IDLE;
+            }
+            active[i] = active[--active_count];
+            reclaimed_grants++;
+        } else {
+            i++;
+        }
+    }
+}
+
+static void refill_tokens(long long now)
+{
+    if (config.rate <= 0.0) {
+        return;
+    }
+
+    tokens += (double)(now - refilled_at_ns) * config.rate / 1e9;
+    if (tokens > config.burst) {
+        tokens = config.burst;
+    }
+    refilled_at_ns = now;
+}
+
+static void arm_timer(long long now)
+{
+    long long next = 0;
+
+    if (heap_size > 0 && active_count < config.max_concurrent &&
+        config.rate > 0.0 && tokens < 1.0) {
+        next = now + (long long)((1.0 - tokens) * 1e9 / config.rate) + 1;
+    }
+    for (size_t i = 0; i < active_count; i++) {
+        if (next == 0 || active[i].expires_ns < next) {
+            next = active[i].expires_ns;
+        }
+    }
+
+    if (!timer_ready) {
+        return;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (next != 0) {
+        spec.it_value.tv_sec = (time_t)(next / 1000000000LL);
+        spec.it_value.tv_nsec = (long)(next % 1000000000LL);
+    }
+    timer_settime(dispatch_timer, TIMER_ABSTIME, &spec, NULL);
+}
+
+static void grant(process_info_t* child, const queue_entry_t* entry, long long now)
+{
+    long long wait = now - child->requested_at_ns;
+
+    child->total_wait_ns += wait;
+    if (wait > child->max_wait_ns) {
+        child->max_wait_ns = wait;
+    }
+    child->grants++;
+    child->grant_state = GRANT_ACTIVE;
+    if (latency_count < latency_capacity) {
+        latency_log[latency_count++] = wait;
+    }
+
+    active[active_count].pid = child->pid;
+    active[active_count].expires_ns = now + GRANT_TIMEOUT_NS;
+    active_count++;
+
+    virtual_time = entry->tag;
+    if (config.rate > 0.0) {
+        tokens -= 1.0;
+    }
+
+    if (kill(child->pid, SIGUSR1) == -1) {
+        perror("Failed to send SIGUSR1");
+    }
+}
+
+void scheduler_init(const scheduler_config_t* cfg)
+{
+    config = *cfg;
+    if (config.max_concurrent == 0) {
+        config.max_concurrent = 1;
+    }
+    if (config.burst < 1.0) {
+        config.burst = 1.0;
+    }
+    tokens = config.burst;
+    refilled_at_ns = monotonic_ns();
+
+    active = (active_grant_t*)calloc(config.max_concurrent, sizeof(active_grant_t));
+    if (!active || !scheduler_reserve(INITIAL_CHILD_CAPACITY)) {
+        perror("Failed to allocate grant scheduler");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = GRANT_TIMER_SIGNAL;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &dispatch_timer) == -1) {
+        perror("Failed to create grant timer");
+        exit(EXIT_FAILURE);
+    }
+    timer_ready = true;
+}
+
+void scheduler_free(void)
+{
+    if (timer_ready) {
+        timer_delete(dispatch_timer);
+        timer_ready = false;
+    }
+    free(heap);
+    free(active);
+    heap = NULL;
+    active = NULL;
+    heap_size = heap_capacity = active_count = 0;
+}
+
+bool scheduler_reserve(size_t capacity)
+{
+    if (capacity <= heap_capacity) {
+        return true;
+    }
+
+    queue_entry_t* entries = (queue_entry_t*)realloc(heap, capacity * sizeof(queue_entry_t));
+    if (!entries) {
+        return false;
+    }
+    heap = entries;
+    heap_capacity = capacity;
+    return true;
+}
+
+void scheduler_request(process_info_t* child)
+{
+    if (child->grant_state == GRANT_ACTIVE) {
+        /* Its "finished" signal was coalesced with another child's. */
+        release_active(child->pid);
+        child->grant_state = GRANT_IDLE;
+        implicit_completions++;
+    }
+
+    if (child->grant_state == GRANT_QUEUED) {
+        return;
+    }
+
+    if (child->is_stopped || heap_size == heap_capacity) {
+        if (kill(child->pid, SIGUSR2) == -1) {
+            perror("Failed to send SIGUSR2");
+        }
+        return;
+    }
+
+    unsigned long long start = child->virtual_finish > virtual_time ? child->virtual_finish
+                                                                    : virtual_time;
+    unsigned int weight = child->weight ? child->weight : 1;
+
+    child->virtual_finish = start + STRIDE / weight;
+    child->requested_at_ns = monotonic_ns();
+    child->grant_state = GRANT_QUEUED;
+
+    heap[heap_size].tag = child->virtual_finish;
+    heap[heap_size].seq = next_seq++;
+    heap[heap_size].pid = child->pid;
+    sift_up(heap_size++);
+
+    scheduler_dispatch();
+}
+
+void scheduler_complete(process_info_t* child)
+{
+    if (child->grant_state == GRANT_ACTIVE) {
+        release_active(child->pid);
+        child->grant_state = GRANT_IDLE;
+    }
+    scheduler_dispatch();
+}
+
+void scheduler_forget(process_info_t* child)
+{
+    if (!child) {
+        return;
+    }
+
+    if (child->grant_state == GRANT_ACTIVE) {
+        release_active(child->pid);
+    } else if (child->grant_state == GRANT_QUEUED) {
+        for (size_t i = 0; i < heap_size; i++) {
+            if (heap[i].pid == child->pid) {
+                heap_remove_at(i);
+                break;
+            }
+        }
+    }
+    child->grant_state = GRANT_IDLE;
+}
+
+void scheduler_reset(void)
+{
+    heap_size = 0;
+    active_count = 0;
+    virtual_time = 0;
+    arm_timer(monotonic_ns());
+}
+
+void scheduler_dispatch(void)
+{
+    long long now = monotonic_ns();
+
+    reclaim_expired(now);
+    refill_tokens(now);
+
+    while (heap_size > 0 && active_count < config.max_concurrent) {
+        if (config.rate > 0.0 && tokens < 1.0) {
+            break;
+        }
+
+        queue_entry_t entry = heap[0];
+        heap_remove_at(0);
+
+        process_info_t* child = registry_find(entry.pid);
+        if (!child || child->grant_state != GRANT_QUEUED) {
+            continue;
+        }
+
+        if (child->is_stopped) {
+            child->grant_state = GRANT_IDLE;
+            if (kill(child->pid, SIGUSR2) == -1) {
+                perror("Failed to send SIGUSR2");
+            }
+            continue;
+        }
+
+        grant(child, &entry, now);
+    }
+
+    arm_timer(now);
+}
+
+size_t scheduler_queued(void)
+{
+    return heap_size;
+}
+
+size_t scheduler_active(void)
+{
+    return active_count;
+}
+
+size_t scheduler_reclaimed(void)
+{
+    return reclaimed_grants;
+}
+
+size_t scheduler_implicit_completions(void)
+{
+    return implicit_completions;
+}
+
+void scheduler_log_latencies(long long* log, size_t capacity)
+{
+    latency_log = log;
+    latency_capacity = log ? capacity : 0;
+    latency_count = 0;
+}
+
+size_t scheduler_logged_latencies(void)
+{
+    return latency_count;
+}
@@ -0,0 +1,37 @@
+#ifndef GRANT_SCHEDULER_H
+#define GRANT_SCHEDULER_H
+#include "globals.h"
+
+typedef struct scheduler_config_s {
+    size_t max_concurrent;  /* grants that may be outstanding at once */
+    double rate;            /* token-bucket refill, grants per second; 0 disables */
+    double burst;           /* token-bucket depth */
+} scheduler_config_t;
+
+/*
+ * Output requests are queued and granted in weighted fair order: each request
+ * gets a virtual finish tag advanced by STRIDE / weight, the smallest tag wins
+ * and equal tags are served FIFO, so equal weights give round-robin.
+ * Everything except scheduler_init() runs either in the parent's signal
+ * handlers or between registry_lock() and registry_unlock().
+ */
+void scheduler_init(const scheduler_config_t* config);
+void scheduler_free(void);
+bool scheduler_reserve(size_t capacity);
+
+void scheduler_request(process_info_t* child);
+void scheduler_complete(process_info_t* child);
+void scheduler_forget(process_info_t* child);
+void scheduler_reset(void);
+void scheduler_dispatch(void);
+
+size_t scheduler_queued(void);
+size_t scheduler_active(void);
+size_t scheduler_reclaimed(void);
+size_t scheduler_implicit_completions(void);
+
+/* Request-to-grant delays in ns are stored into log until it is full. */
+void scheduler_log_latencies(long long* log, size_t capacity);
+size_t scheduler_logged_latencies(void);
+
+#endif
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include "child_registry.h"
+#include "output_relay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define STDIN_TAG UINT64_MAX
+#define RELAY_BUFFER_SIZE 65536
+#define EPOLL_BATCH 64
+
+static int epfd = -1;
+static bool stdin_wanted = false;
+static bool stdin_watched = false;
+static relay_hook_t record_hook = NULL;
+static char out_buffer[RELAY_BUFFER_SIZE];
+static size_t out_used = 0;
+
+static void write_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to relay child output");
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+void relay_flush(void)
+{
+    if (out_used == 0) {
+        return;
+    }
+    fflush(stdout);
+    write_all(STDOUT_FILENO, out_buffer, out_used);
+    out_used = 0;
+}
+
+static void relay_record(const process_info_t* child, const char* record, size_t len)
+{
+    size_t needed = strlen(child->name) + 3 + len + 1;
+
+    if (record_hook && record_hook(child, record, len)) {
+        return;
+    }
+
+    if (out_used + needed > sizeof(out_buffer)) {
+        relay_flush();
+    }
+    if (needed > sizeof(out_buffer)) {
+        return;
+    }
+
+    out_used += (size_t)sprintf(out_buffer + out_used, "[%s] ", child->name);
+    memcpy(out_buffer + out_used, record, len);
+    out_used += len;
+    if (record[len - 1] != '\n') {
+        out_buffer[out_used++] = '\n';
+    }
+}
+
+/*
+ * Forwards complete lines only; a tail without '\n' waits for the next read.
+ * Returns false once the pipe reaches EOF.
+ */
+static bool read_available(process_info_t* child)
+{
+    char chunk[PIPE_CHUNK_SIZE];
+
+    for (;;) {
+        ssize_t n = read(child->output_fd, chunk, sizeof(chunk));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == -1 && errno == EAGAIN;
+        }
+
+        for (ssize_t i = 0; i < n; i++) {
+            child->pending[child->pending_len++] = chunk[i];
+            if (chunk[i] == '\n' || child->pending_len == REPORT_LENGTH) {
+                relay_record(child, child->pending, child->pending_len);
+                child->pending_len = 0;
+            }
+        }
+    }
+}
+
+void relay_init(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) {
+        perror("Failed to create epoll instance");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void relay_watch_stdin(void)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = STDIN_TAG;
+
+    stdin_wanted = true;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0) {
+        stdin_watched = true;
+    } else if (errno != EPERM) {
+        perror("Failed to watch stdin");
+    }
+}
+
+void relay_set_hook(relay_hook_t hook)
+{
+    record_hook = hook;
+}
+
+void relay_free(void)
+{
+    relay_flush();
+    if (epfd != -1) {
+        close(epfd);
+        epfd = -1;
+    }
+}
+
+int relay_open_pipe(int fds[2])
+{
+    return pipe2(fds, O_CLOEXEC);
+}
+
+/* Runs in the forked child: the write end becomes REPORT_FD across exec. */
+void relay_prepare_child(int fds[2])
+{
+    if (fds[1] == REPORT_FD) {
+        fcntl(REPORT_FD, F_SETFD, 0);
+    } else if (dup2(fds[1], REPORT_FD) == -1) {
+        perror("Failed to set up report pipe");
+        _exit(EXIT_FAILURE);
+    }
+}
+
+bool relay_watch_child(process_info_t* child, int read_fd)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)child->pid;
+
+    if (fcntl(read_fd, F_SETFL, O_NONBLOCK) == -1 ||
+        epoll_ctl(epfd, EPOLL_CTL_ADD, read_fd, &ev) == -1) {
+        perror("Failed to watch child output");
+        close(read_fd);
+        return false;
+    }
+
+    child->output_fd = read_fd;
+    child->pending_len = 0;
+    return true;
+}
+
+void relay_forget_child(process_info_t* child)
+{
+    if (child->output_fd < 0) {
+        return;
+    }
+
+    read_available(child);
+    if (child->pending_len > 0) {
+        relay_record(child, child->pending, child->pending_len);
+        child->pending_len = 0;
+    }
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, child->output_fd, NULL);
+    close(child->output_fd);
+    child->output_fd = -1;
+}
+
+bool relay_poll(int timeout_ms)
+{
+    struct epoll_event events[EPOLL_BATCH];
+    /* A regular file on stdin cannot be polled and is always readable. */
+    bool stdin_ready = stdin_wanted && !stdin_watched;
+
+    if (stdin_ready) {
+        timeout_ms = 0;
+    }
+    relay_flush();
+    int ready = epoll_wait(epfd, events, EPOLL_BATCH, timeout_ms);
+    if (ready == -1 && errno != EINTR) {
+        perror("epoll_wait failed");
+    }
+
+    for (int i = 0; i < ready; i++) {
+        if (events[i].data.u64 == STDIN_TAG) {
+            stdin_ready = true;
+            continue;
+        }
+
+        process_info_t* child = registry_find((pid_t)events[i].data.u64);
+        if (child && child->output_fd >= 0 && !read_available(child)) {
+            relay_forget_child(child);
+        }
+    }
+
+    relay_flush();
+    return stdin_ready;
+}
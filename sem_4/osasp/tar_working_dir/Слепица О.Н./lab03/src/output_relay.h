@@ -0,0 +1,30 @@
+#ifndef OUTPUT_RELAY_H
+#define OUTPUT_RELAY_H
+#include "globals.h"
+
+/*
+ * Every child writes its reports into a private pipe (REPORT_FD on the child
+ * side). The parent waits on all pipes (and on stdin, once the interactive
+ * loop asks for it) through one epoll instance, assembles complete lines and
+ * forwards them, tagged with the child name, through a single buffered
+ * writer on stdout.
+ */
+/* Returns true when it consumed the record, which is then not printed. */
+typedef bool (*relay_hook_t)(const process_info_t* child, const char* record, size_t len);
+
+void relay_init(void);
+/* Only for the interactive loop: relay_poll() then also reports stdin. */
+void relay_watch_stdin(void);
+void relay_set_hook(relay_hook_t hook);
+void relay_free(void);
+
+int relay_open_pipe(int fds[2]);
+void relay_prepare_child(int fds[2]);
+bool relay_watch_child(process_info_t* child, int read_fd);
+void relay_forget_child(process_info_t* child);
+
+/* Waits up to timeout_ms (-1 = forever); returns true when watched stdin is readable. */
+bool relay_poll(int timeout_ms);
+void relay_flush(void);
+
+#endif
@@ -1,12 +1,61 @@
 #include "parent_ops.h"
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STRESS_DEFAULT_SECONDS 15
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+            "Usage: %s [-c grants] [-r grants_per_sec] [-b burst]\n"
+            "          [-s children [-t seconds] [-f rate_hz] [-n samples_per_report]]\n"
+            "       %s --stress children [seconds [rate_hz [samples_per_report]]]\n",
+            program, program);
+}
 
 int main(int argc, char* argv[])
 {
-    (void)argc;  
-    (void)argv; 
+    scheduler_config_t config = {1, 0.0, 1.0};
+    size_t stress_children = 0;
+    unsigned int stress_seconds = STRESS_DEFAULT_SECONDS;
+    char* sample_rate = NULL;
+    char* samples_per_report = NULL;
+    int opt;
+
+    /* The original positional form, kept working next to -s/-t/-f/-n. */
+    if (argc > 2 && strcmp(argv[1], "--stress") == 0) {
+        stress_children = strtoul(argv[2], NULL, 10);
+        if (argc > 3) stress_seconds = (unsigned int)strtoul(argv[3], NULL, 10);
+        if (argc > 4) sample_rate = argv[4];
+        if (argc > 5) samples_per_report = argv[5];
+        optind = argc;
+    }
+
+    while ((opt = getopt(argc, argv, "c:r:b:s:t:f:n:")) != -1) {
+        switch (opt) {
+            case 'c': config.max_concurrent = strtoul(optarg, NULL, 10); break;
+            case 'r': config.rate = strtod(optarg, NULL); break;
+            case 'b': config.burst = strtod(optarg, NULL); break;
+            case 's': stress_children = strtoul(optarg, NULL, 10); break;
+            case 't': stress_seconds = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'f': sample_rate = optarg; break;
+            case 'n': samples_per_report = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    init_parent(&config);
+
+    if (stress_children > 0) {
+        set_child_arguments(sample_rate, samples_per_report);
+        run_stress_test(stress_children, stress_seconds);
+        cleanup_parent();
+        return EXIT_SUCCESS;
+    }
 
-    init_parent();
     parent_main_loop();
 
     return EXIT_SUCCESS;
@@ -2,6 +2,10 @@
 #define _POSIX_C_SOURCE 199309L
 #include "parent_ops.h"
 #include "globals.h"
+#include "child_registry.h"
+#include "grant_scheduler.h"
+#include "child_reaper.h"
+#include "output_relay.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -10,13 +14,26 @@
 #include <sys/wait.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
 #ifndef SA_RESTART
 #define SA_RESTART 0x10000000
 #endif
 
-size_t num_child_processes = 0;
-size_t max_child_processes = MAX_CHILDREN;
-process_info_t* child_processes = NULL;
+#define LOOKUP_BENCH_ROUNDS 1000
+#define TERMINATE_GRACE_MS 2000
+#define INPUT_LENGTH 64
+
+volatile sig_atomic_t quiet_mode = false;
+volatile sig_atomic_t unknown_signals = 0;
+volatile sig_atomic_t requests_seen = 0;
+volatile sig_atomic_t reports_seen = 0;
+static size_t next_child_id = 0;
+static char* child_argv[] = {"./child", NULL, NULL, NULL};
+
+void set_child_arguments(char* sample_rate_hz, char* samples_per_report) {
+    child_argv[1] = sample_rate_hz;
+    child_argv[2] = sample_rate_hz ? samples_per_report : NULL;
+}
 
 void handle_alarm_signal(int sig) {
     if (sig == SIGALRM) {
@@ -28,48 +45,56 @@ void handle_alarm_signal(int sig) {
 void handle_parent_signals(int sig, siginfo_t* info, void* context) {
     (void)context;
 
-    for (size_t i = 0; i < num_child_processes; i++) {
-        if (child_processes[i].pid == info->si_pid) {
-            if (sig == SIGUSR1) {
-                if (child_processes[i].is_stopped) {
-                    if (kill(info->si_pid, SIGUSR2) == -1) {
-                        perror("Failed to send SIGUSR2");
-                    }
-                } else {
-                    if (kill(info->si_pid, SIGUSR1) == -1) {
-                        perror("Failed to send SIGUSR1");
-                    }
-                }
-            }
-            else if (sig == SIGUSR2) {
-                printf("C_%d finished output\n", info->si_pid);
-            }
-            return;
+    process_info_t* child = registry_find(info->si_pid);
+    if (!child) {
+        unknown_signals++;
+        if (!quiet_mode) {
+            printf("Received signal from unknown child PID: %d\n", info->si_pid);
         }
+        return;
     }
-    printf("Received signal from unknown child PID: %d\n", info->si_pid);
-}
 
-void init_parent() {
-    child_processes = (process_info_t*)malloc(max_child_processes * sizeof(process_info_t));
-    if (!child_processes) {
-        perror("Failed to allocate memory for child processes");
-        exit(EXIT_FAILURE);
+    if (sig == SIGUSR1) {
+        requests_seen++;
+        child->requests++;
+        scheduler_request(child);
     }
-
-    for (size_t i = 0; i < max_child_processes; i++) {
-        child_processes[i].pid = 0;
-        child_processes[i].is_stopped = false;
-        memset(child_processes[i].name, 0, CHILD_NAME_LENGTH);
+    else if (sig == SIGUSR2) {
+        reports_seen++;
+        child->reports++;
+        scheduler_complete(child);
+        if (!quiet_mode) {
+            printf("C_%d finished output\n", info->si_pid);
+        }
     }
+}
+
+void handle_grant_timer(int sig) {
+    (void)sig;
+    scheduler_dispatch();
+}
+
+void init_parent(const scheduler_config_t* config) {
+    registry_init();
+    scheduler_init(config);
+    relay_init();
 
     struct sigaction sa;
     sa.sa_sigaction = handle_parent_signals;
     sa.sa_flags = SA_SIGINFO | SA_RESTART;
     sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, SIGUSR1);
+    sigaddset(&sa.sa_mask, SIGUSR2);
+    sigaddset(&sa.sa_mask, GRANT_TIMER_SIGNAL);
+
+    struct sigaction timer_sa;
+    timer_sa.sa_handler = handle_grant_timer;
+    timer_sa.sa_flags = SA_RESTART;
+    timer_sa.sa_mask = sa.sa_mask;
 
     if (sigaction(SIGUSR1, &sa, NULL) == -1 ||
-        sigaction(SIGUSR2, &sa, NULL) == -1) {
+        sigaction(SIGUSR2, &sa, NULL) == -1 ||
+        sigaction(GRANT_TIMER_SIGNAL, &timer_sa, NULL) == -1) {
         perror("Failed to set signal handlers");
         exit(EXIT_FAILURE);
     }
@@ -80,40 +105,84 @@ void init_parent() {
 void cleanup_parent() {
     alarm(0);
     terminate_all_children();
-    free(child_processes);
-    child_processes = NULL;
+    scheduler_free();
+    relay_free();
+    registry_free();
 }
 
-void spawn_child_process() {
-    if (num_child_processes >= max_child_processes) {
-        printf("Maximum number of children (%zu) reached\n", max_child_processes);
-        return;
+bool spawn_child_process() {
+    sigset_t saved;
+    int fds[2];
+
+    if (relay_open_pipe(fds) == -1) {
+        perror("Failed to create report pipe");
+        return false;
     }
 
+    /* Signals from the new child stay pending until it is registered. */
+    registry_lock(&saved);
+
     pid_t pid = fork();
     if (pid == -1) {
         perror("Failed to fork");
-        return;
+        registry_unlock(&saved);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
     }
 
     if (pid == 0) {
-        execl("./child", "./child", NULL);
+        registry_unlock(&saved);
+        relay_prepare_child(fds);
+        execv(child_argv[0], child_argv);
         perror("Failed to exec child");
         _exit(EXIT_FAILURE);
     }
-    else {
-        child_processes[num_child_processes].pid = pid;
-        child_processes[num_child_processes].is_stopped = false;
-        if (snprintf(child_processes[num_child_processes].name, CHILD_NAME_LENGTH,
-                   "C_%zu", num_child_processes + 1) < 0) {
-            perror("Failed to create child name");
-            kill(pid, SIGTERM);
-            waitpid(pid, NULL, 0);
-            return;
+
+    close(fds[1]);
+    process_info_t* child = registry_add(pid);
+    if (!child || !scheduler_reserve(max_child_processes) ||
+        snprintf(child->name, CHILD_NAME_LENGTH, "C_%zu", next_child_id + 1) < 0 ||
+        !relay_watch_child(child, fds[0])) {
+        perror("Failed to register child");
+        if (child) {
+            if (child->output_fd < 0) {
+                close(fds[0]);
+            }
+            relay_forget_child(child);
+            registry_remove(pid);
+        } else {
+            close(fds[0]);
         }
+        registry_unlock(&saved);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return false;
+    }
+    child->weight = 1;
+    next_child_id++;
+    registry_unlock(&saved);
+
+    if (!quiet_mode) {
+        printf("Created %s (PID: %d)\n", child->name, pid);
+    }
+    return true;
+}
 
-        num_child_processes++;
-        printf("Created C_%zu (PID: %d)\n", num_child_processes, pid);
+void reap_exited_children() {
+    pid_t pid;
+    sigset_t saved;
+
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        registry_lock(&saved);
+        process_info_t* child = registry_find(pid);
+        if (child) {
+            printf("%s (PID: %d) exited\n", child->name, pid);
+            relay_forget_child(child);
+            scheduler_forget(child);
+            registry_remove(pid);
+        }
+        registry_unlock(&saved);
     }
 }
 
@@ -123,22 +192,25 @@ void terminate_last_child() {
         return;
     }
 
-    size_t index = num_child_processes - 1;
-    pid_t pid = child_processes[index].pid;
+    process_info_t last = *registry_newest();
+    pid_t pid = last.pid;
 
-    if (kill(pid, SIGTERM) == -1) {
-        perror("Failed to send SIGTERM");
-        return;
+    if (terminate_children(&pid, 1, TERMINATE_GRACE_MS) > 0) {
+        printf("%s did not exit in time and was killed\n", last.name);
     }
 
-    int status;
-    if (waitpid(pid, &status, 0) == -1) {
-        perror("Failed to wait for child");
+    sigset_t saved;
+    registry_lock(&saved);
+    process_info_t* child = registry_find(pid);
+    if (child) {
+        relay_forget_child(child);
+        scheduler_forget(child);
     }
+    registry_remove(pid);
+    registry_unlock(&saved);
 
-    num_child_processes--;
-    printf("Removed C_%zu (PID: %d). %zu children remaining\n",
-           index+1, pid, num_child_processes);
+    printf("Removed %s (PID: %d). %zu children remaining\n",
+           last.name, pid, num_child_processes);
 }
 
 void terminate_all_children() {
@@ -148,34 +220,78 @@ void terminate_all_children() {
     }
 
     printf("Removing all %zu C_XX...\n", num_child_processes);
-    for (size_t i = 0; i < num_child_processes; i++) {
-        if (child_processes[i].pid > 0) {
-            if (kill(child_processes[i].pid, SIGTERM) == -1) {
-                perror("Failed to send SIGTERM");
-            }
-            if (waitpid(child_processes[i].pid, NULL, 0) == -1) {
-                perror("Failed to wait for child");
-            }
-        }
+
+    pid_t* pids = (pid_t*)malloc(num_child_processes * sizeof(pid_t));
+    if (!pids) {
+        perror("Failed to allocate pid list");
+        return;
+    }
+    size_t count = num_child_processes;
+    for (size_t i = 0; i < count; i++) {
+        pids[i] = child_processes[i].pid;
+    }
+
+    size_t killed = terminate_children(pids, count, TERMINATE_GRACE_MS);
+    free(pids);
+    if (killed > 0) {
+        printf("%zu children did not exit in time and were killed\n", killed);
     }
 
-    num_child_processes = 0;
+    sigset_t saved;
+    registry_lock(&saved);
+    for (size_t i = 0; i < num_child_processes; i++) {
+        relay_forget_child(&child_processes[i]);
+    }
+    scheduler_reset();
+    registry_clear();
+    registry_unlock(&saved);
     printf("All children removed\n");
 }
 
+static double average_wait_ms(const process_info_t* child) {
+    return child->grants ? (double)child->total_wait_ns / (double)child->grants / 1e6 : 0.0;
+}
+
 void display_process_list() {
+    sigset_t saved;
+    registry_lock(&saved);
+
     printf(SEPARATE);
     printf("Parent PID: %d\n", getpid());
-    printf("Child processes (%zu):\n", num_child_processes);
+    printf("Child processes (%zu), queued: %zu, granted: %zu\n",
+           num_child_processes, scheduler_queued(), scheduler_active());
 
     for (size_t i = 0; i < num_child_processes; i++) {
-        printf("%zu. %s (PID: %d, %s)\n",
+        const process_info_t* child = &child_processes[i];
+        printf("%zu. %s (PID: %d, %s, weight: %u, requests: %d, reports: %d, "
+               "grants: %zu, wait avg/max: %.2f/%.2f ms)\n",
                i + 1,
-               child_processes[i].name,
-               child_processes[i].pid,
-               child_processes[i].is_stopped ? "stopped" : "running");
+               child->name,
+               child->pid,
+               child->is_stopped ? "stopped" : "running",
+               child->weight,
+               (int)child->requests,
+               (int)child->reports,
+               child->grants,
+               average_wait_ms(child),
+               (double)child->max_wait_ns / 1e6);
     }
     printf(SEPARATE);
+
+    registry_unlock(&saved);
+}
+
+void set_child_weight(int child_num, unsigned int weight) {
+    if (child_num > 0 && child_num <= (int)num_child_processes && weight > 0) {
+        sigset_t saved;
+        registry_lock(&saved);
+        child_processes[child_num-1].weight = weight;
+        registry_unlock(&saved);
+        printf("Set weight %u for child %d (PID: %d)\n",
+               weight, child_num, child_processes[child_num-1].pid);
+    } else {
+        printf("Usage: w<num> <weight> (weight > 0)\n");
+    }
 }
 
 void block_all_child_output() {
@@ -261,6 +377,15 @@ void handle_user_command(const char* input) {
                 printf("Usage: p<num> (e.g. p1)\n");
             }
             break;
+        case 'w':
+            if (strlen(input) > 1 && isdigit(input[1])) {
+                char* end;
+                int child_num = (int)strtol(&input[1], &end, 10);
+                set_child_weight(child_num, (unsigned int)strtoul(end, NULL, 10));
+            } else {
+                printf("Usage: w<num> <weight> (e.g. w1 3)\n");
+            }
+            break;
         case 'q':
             cleanup_parent();
             exit(EXIT_SUCCESS);
@@ -272,6 +397,7 @@ void handle_user_command(const char* input) {
             printf("  s<num> : Disable output for child <num>\n");
             printf("  g<num> : Enable output for child <num>\n");
             printf("  p<num> : Request output from child <num>\n");
+            printf("  w<num> <weight> : Set output share of child <num>\n");
             printf("  q : Quit\n");
             break;
         default:
@@ -280,31 +406,152 @@ void handle_user_command(const char* input) {
     }
 }
 
+static void run_input_line(char* line) {
+    reap_exited_children();
+
+    if (strcmp(line, "help") == 0) {
+        handle_user_command("?");
+    } else {
+        handle_user_command(line);
+    }
+
+    printf("> ");
+    fflush(stdout);
+}
+
+/*
+ * Commands and child reports share one epoll loop, so stdin is read with
+ * read() into our own line buffer instead of through stdio.
+ */
 void parent_main_loop() {
-    char input[32];
+    char input[INPUT_LENGTH];
+    size_t input_len = 0;
 
     printf("Parent process started. PID: %d\n", getpid());
     printf("Type 'help' for available commands\n");
+    printf("> ");
+    fflush(stdout);
+    relay_watch_stdin();
 
     while (1) {
-        printf("> ");
-        fflush(stdout);
-
-        if (fgets(input, sizeof(input), stdin)) {
-            input[strcspn(input, "\n")] = '\0';
+        if (!relay_poll(-1)) {
+            continue;
+        }
 
-            if (strcmp(input, "help") == 0) {
-                handle_user_command("?");
-            } else {
-                handle_user_command(input);
+        ssize_t n = read(STDIN_FILENO, input + input_len, sizeof(input) - 1 - input_len);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
             }
-        } else {
-            clearerr(stdin);
+            perror("Failed to read command");
+            n = 0;
+        }
+        if (n == 0) {
             printf("\n");
+            handle_user_command("q");
+        }
+        input_len += (size_t)n;
+
+        char* newline;
+        while ((newline = memchr(input, '\n', input_len)) != NULL) {
+            size_t consumed = (size_t)(newline - input) + 1;
+            *newline = '\0';
+            run_input_line(input);
+            memmove(input, input + consumed, input_len - consumed);
+            input_len -= consumed;
+        }
+
+        if (input_len == sizeof(input) - 1) {
+            printf("Command too long\n> ");
+            fflush(stdout);
+            input_len = 0;
         }
     }
 }
 
+static double seconds_between(const struct timespec* from, const struct timespec* to) {
+    return (double)(to->tv_sec - from->tv_sec) + (double)(to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static size_t count_handled_signals(void) {
+    size_t total = 0;
+    for (size_t i = 0; i < num_child_processes; i++) {
+        total += (size_t)child_processes[i].requests + (size_t)child_processes[i].reports;
+    }
+    return total;
+}
+
+void run_stress_test(size_t count, unsigned int seconds) {
+    struct timespec start, end;
+
+    quiet_mode = true;
+    printf("Stress test: spawning %zu children for %u s\n", count, seconds);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        if (!spawn_child_process()) {
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Spawned %zu children in %.3f s\n", num_child_processes, seconds_between(&start, &end));
+
+    if (num_child_processes > 0) {
+        size_t hits = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t round = 0; round < LOOKUP_BENCH_ROUNDS; round++) {
+            for (size_t i = 0; i < num_child_processes; i++) {
+                hits += registry_find(child_processes[i].pid) != NULL;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Registry lookup: %.1f ns per pid (%zu hits)\n",
+               seconds_between(&start, &end) * 1e9 / (double)hits, hits);
+    }
+
+    size_t before = count_handled_signals();
+    int unknown_before = unknown_signals;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double left = (double)seconds - seconds_between(&start, &end);
+        if (left <= 0) {
+            break;
+        }
+        relay_poll((int)(left * 1000) + 1);
+    }
+
+    size_t handled = count_handled_signals() - before;
+    double elapsed = seconds_between(&start, &end);
+    printf("Handled %zu child signals in %.3f s: %.1f signals/s (unknown: %d)\n",
+           handled, elapsed, (double)handled / elapsed, unknown_signals - unknown_before);
+
+    sigset_t saved;
+    size_t grants = 0;
+    long long total_wait = 0;
+    const process_info_t* slowest = NULL;
+    registry_lock(&saved);
+    for (size_t i = 0; i < num_child_processes; i++) {
+        grants += child_processes[i].grants;
+        total_wait += child_processes[i].total_wait_ns;
+        if (!slowest || child_processes[i].max_wait_ns > slowest->max_wait_ns) {
+            slowest = &child_processes[i];
+        }
+    }
+    if (slowest) {
+        printf("Grants: %zu, avg queueing delay %.2f ms, worst %s %.2f ms, reclaimed: %zu\n",
+               grants, grants ? (double)total_wait / (double)grants / 1e6 : 0.0,
+               slowest->name, (double)slowest->max_wait_ns / 1e6, scheduler_reclaimed());
+    }
+    registry_unlock(&saved);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    terminate_all_children();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Shutdown took %.3f s\n", seconds_between(&start, &end));
+    quiet_mode = false;
+}
+
 void print_status(const char* message) {
     printf("[PARENT %d] %s\n", getpid(), message);
 }
@@ -2,11 +2,18 @@
 #define PARENT_OPS_H
 #define _POSIX_C_SOURCE 199309L
 #include "globals.h"
+#include "grant_scheduler.h"
+
+extern volatile sig_atomic_t quiet_mode;
+extern volatile sig_atomic_t unknown_signals;
+extern volatile sig_atomic_t requests_seen;   /* SIGUSR1 from known children, never reset */
+extern volatile sig_atomic_t reports_seen;    /* SIGUSR2 from known children, never reset */
 
 void parent_main_loop();
-void init_parent();
+void init_parent(const scheduler_config_t* config);
 void cleanup_parent();
-void spawn_child_process();
+bool spawn_child_process();
+void reap_exited_children();
 void terminate_last_child();
 void terminate_all_children();
 void display_process_list();
@@ -18,5 +25,8 @@ void unblock_all_child_output();
 void block_child_output(int child_num);
 void unblock_child_output(int child_num);
 void request_child_stats(int child_num);
+void set_child_weight(int child_num, unsigned int weight);
 void handle_alarm_signal(int sig);
+void run_stress_test(size_t count, unsigned int seconds);
+void set_child_arguments(char* sample_rate_hz, char* samples_per_report);
 #endif
@@ -0,0 +1,187 @@
+#ifndef LAB04_AUTOSCALE_H
+#define LAB04_AUTOSCALE_H
+
+#include "header.h"
+#include <math.h>
+#include <pthread.h>
+
+#define AUTOSCALE_LOG "autoscale.log"
+#define AUTOSCALE_PERIOD_NS 500000000L
+#define AUTOSCALE_HIGH 75
+#define AUTOSCALE_LOW 10
+#define AUTOSCALE_LAG_HIGH 10.0
+#define AUTOSCALE_UP_SAMPLES 2
+#define AUTOSCALE_DOWN_SAMPLES 6
+#define AUTOSCALE_COOLDOWN_NS 2000000000ull
+#define AUTOSCALE_SMOOTHING 0.25
+
+/*
+ * Autoscaling (-A min:max in main): a thread samples the queue every
+ * AUTOSCALE_PERIOD_NS and adds or retires consumers through main's
+ * callbacks. It grows on a nearly full queue that is not draining, or on a
+ * lag (seconds the consumers need for the backlog) above
+ * AUTOSCALE_LAG_HIGH, and it only ever retires consumers it started
+ * itself: ones added from the menu are the operator's, even above max.
+ * Hysteresis comes from three places: the gap between the
+ * AUTOSCALE_HIGH and AUTOSCALE_LOW watermarks, a run of consecutive
+ * samples before acting (a short run to grow, a longer one to shrink) and
+ * a cooldown after every change, so that the new consumer count shows up
+ * in the samples before the next decision. Every decision is appended to
+ * the log with the sample that caused it. The rates are moving averages:
+ * interactive workers handle a message every few seconds, far less often
+ * than the sampling period.
+ */
+typedef struct {
+    int min;
+    int max;
+    int (*count)(void);
+    int (*spawned)(void);
+    void (*grow)(void);
+    void (*shrink)(void);
+    queue *segment;
+    FILE *log;
+    atomic_bool stop;
+    pthread_t thread;
+    uint64_t decisions;
+} autoscaler;
+
+/*
+ * One look at the queue: fill of the fullest shard and the message counters
+ * of all of them. The counters wrap at 2^32, so only differences taken in
+ * uint32_t arithmetic mean anything.
+ */
+typedef struct {
+    unsigned int fill;
+    uint32_t added;
+    uint32_t extracted;
+    uint64_t at_ns;
+} load_sample;
+
+void autoscale_sample(queue *segment, load_sample *sample) {
+    memset(sample, 0, sizeof(*sample));
+    for (size_t i = 0; i < segment->shards; i++) {
+        queue *ring = queue_shard(segment, i);
+        size_t used = queue_byte_mode(ring) ? ring_used(queue_bytes(ring)) : queue_length(ring);
+        size_t size = queue_byte_mode(ring) ? ring->byte_ring_size : ring->capacity;
+        unsigned int fill = (unsigned int)(used * 100 / size);
+
+        /* Consumers steal from other shards, but a hot shard still means too few of them. */
+        if (fill > sample->fill) {
+            sample->fill = fill;
+        }
+        sample->added += (uint32_t)atomic_load(&ring->added_count);
+        sample->extracted += (uint32_t)atomic_load(&ring->extracted_count);
+    }
+    sample->at_ns = monotonic_ns();
+}
+
+/* Counters are read one shard at a time, so extracted may run a little ahead: that is no backlog. */
+uint64_t autoscale_backlog(const load_sample *sample) {
+    uint32_t backlog = sample->added - sample->extracted;
+    return backlog > INT32_MAX ? 0 : backlog;
+}
+
+/* Seconds the consumers need for the backlog at out_rate; infinite when a backlog is not drained at all. */
+double autoscale_lag(const load_sample *sample, double out_rate) {
+    uint64_t backlog = autoscale_backlog(sample);
+    if (backlog == 0) {
+        return 0.0;
+    }
+    return out_rate > 0 ? (double)backlog / out_rate : INFINITY;
+}
+
+/* Appends a decision: time, the sample, consumer lag and the change. */
+void autoscale_record(autoscaler *scaler, const load_sample *now, double in_rate, double out_rate,
+                      int from, int to, const char *reason) {
+    uint64_t backlog = autoscale_backlog(now);
+    double seconds = autoscale_lag(now, out_rate);
+    char stamp[32];
+    char lag[32] = "-";
+    time_t t = time(NULL);
+
+    if (isfinite(seconds)) {
+        snprintf(lag, sizeof(lag), "%.1fs", seconds);
+    }
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    fprintf(scaler->log, "%s fill=%u%% backlog=%" PRIu64 " in=%.2f/s out=%.2f/s lag=%s consumers %d -> %d (%s)\n",
+            stamp, now->fill, backlog, in_rate, out_rate, lag, from, to, reason);
+    fflush(scaler->log);
+    scaler->decisions++;
+}
+
+void *autoscale_run(void *arg) {
+    autoscaler *scaler = (autoscaler *)arg;
+    struct timespec period = {0, AUTOSCALE_PERIOD_NS};
+    load_sample last, now;
+    double in_rate = 0.0, out_rate = 0.0;
+    int high_run = 0, low_run = 0;
+    uint64_t quiet_until = 0;
+
+    autoscale_sample(scaler->segment, &last);
+    while (!atomic_load(&scaler->stop)) {
+        nanosleep(&period, NULL);
+        autoscale_sample(scaler->segment, &now);
+
+        double seconds = (double)(now.at_ns - last.at_ns) / 1e9;
+        uint32_t added = now.added - last.added;
+        uint32_t extracted = now.extracted - last.extracted;
+        in_rate += AUTOSCALE_SMOOTHING * ((double)added / seconds - in_rate);
+        out_rate += AUTOSCALE_SMOOTHING * ((double)extracted / seconds - out_rate);
+        int consumers = scaler->count();
+        last = now;
+
+        /* Pressure: nearly full and not draining, or lagging. Idle: nearly empty. */
+        bool filling = now.fill >= AUTOSCALE_HIGH && in_rate >= out_rate;
+        bool lagging = autoscale_lag(&now, out_rate) >= AUTOSCALE_LAG_HIGH;
+        high_run = filling || lagging ? high_run + 1 : 0;
+        low_run = now.fill <= AUTOSCALE_LOW ? low_run + 1 : 0;
+        bool own = scaler->spawned() > 0;
+
+        if (consumers < scaler->min) {
+            scaler->grow();
+            autoscale_record(scaler, &now, in_rate, out_rate, consumers, consumers + 1, "below min");
+        } else if (consumers > scaler->max && own) {
+            scaler->shrink();
+            autoscale_record(scaler, &now, in_rate, out_rate, consumers, consumers - 1, "above max");
+        } else if (now.at_ns < quiet_until) {
+            continue;
+        } else if (high_run >= AUTOSCALE_UP_SAMPLES && consumers < scaler->max) {
+            scaler->grow();
+            autoscale_record(scaler, &now, in_rate, out_rate, consumers, consumers + 1,
+                             filling ? "queue filling" : "consumers lagging");
+        } else if (low_run >= AUTOSCALE_DOWN_SAMPLES && consumers > scaler->min && own) {
+            scaler->shrink();
+            autoscale_record(scaler, &now, in_rate, out_rate, consumers, consumers - 1, "queue idle");
+        } else {
+            continue;
+        }
+        high_run = low_run = 0;
+        quiet_until = now.at_ns + AUTOSCALE_COOLDOWN_NS;
+    }
+    return NULL;
+}
+
+void autoscale_start(autoscaler *scaler, queue *segment, const char *log_path) {
+    scaler->segment = segment;
+    scaler->decisions = 0;
+    atomic_init(&scaler->stop, false);
+    scaler->log = fopen(log_path, "a");
+    if (!scaler->log) {
+        perror(log_path);
+        exit(EXIT_FAILURE);
+    }
+
+    int err = pthread_create(&scaler->thread, NULL, autoscale_run, scaler);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(EXIT_FAILURE);
+    }
+}
+
+void autoscale_stop(autoscaler *scaler) {
+    atomic_store(&scaler->stop, true);
+    pthread_join(scaler->thread, NULL);
+    fclose(scaler->log);
+}
+
+#endif // LAB04_AUTOSCALE_H
@@ -0,0 +1,465 @@
+#include "bench.h"
+#include "durable.h"
+#include "corpus.h"
+#include "generator.h"
+
+#define DEFAULT_SECONDS 5
+#define DEFAULT_SLOTS 1024
+#define DEFAULT_PAYLOAD 64
+#define DEFAULT_RING_BYTES (256 * 1024)
+#define READY_TIMEOUT_NS 5000000000ull
+#define CHAOS_WINDOW_NS 1000000000ull
+
+queue *q;
+_Thread_local volatile sig_atomic_t terminate = 0;
+
+typedef struct {
+    const char *label;
+    uint32_t features;
+    size_t batch;
+} bench_config;
+
+typedef struct {
+    int producers;
+    int consumers;
+    unsigned int seconds;
+    size_t slots;
+    size_t payload;
+    size_t ring_bytes;
+    int hash_algo;
+    bool pin;
+    size_t shards;
+    const char *file;
+    bool events;
+    const char *corpus;
+    double message_bytes;
+    unsigned int kill_ms;
+} bench_options;
+
+typedef struct {
+    double seconds;
+    uint64_t sent;
+    uint64_t received;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+    uint64_t kills;
+    uint64_t repairs;
+    double worst_rate;
+    unsigned int windows;
+    unsigned int stalled_windows;
+} bench_result;
+
+/*
+ * shard < 0: all shards (producers); otherwise a consumer homed on that shard, stealing when idle.
+ * corpus, if not NULL, is passed to producers for replay.
+ */
+pid_t spawn_worker(const char *path, int index, size_t batch, int cpu, int shard, const char *corpus) {
+    char index_arg[16], batch_arg[16], cpu_arg[16], shard_arg[16];
+    snprintf(index_arg, sizeof(index_arg), "%d", index);
+    snprintf(batch_arg, sizeof(batch_arg), "%zu", batch);
+    snprintf(cpu_arg, sizeof(cpu_arg), "%d", cpu);
+    snprintf(shard_arg, sizeof(shard_arg), "%d", shard);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        if (shard >= 0) {
+            execl(path, path, "-k", batch_arg, "-x", index_arg, "-c", cpu_arg,
+                  "-s", shard_arg, "-w", NULL);
+        } else if (corpus) {
+            execl(path, path, "-k", batch_arg, "-x", index_arg, "-c", cpu_arg, "-R", corpus, NULL);
+        } else {
+            execl(path, path, "-k", batch_arg, "-x", index_arg, "-c", cpu_arg, NULL);
+        }
+        perror("execl");
+        exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+double percentile_us(const uint64_t *histogram, uint64_t total, double p) {
+    if (total == 0) {
+        return 0.0;
+    }
+
+    uint64_t target = (uint64_t)(p * (double)total);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram[bucket];
+        if (seen > target) {
+            return (double)latency_bucket_value(bucket) / 1e3;
+        }
+    }
+    return 0.0;
+}
+
+/* Messages consumed so far; the workers are still writing their counters. */
+uint64_t bench_received(bench_shared *bench, int consumers) {
+    uint64_t received = 0;
+    for (int i = 0; i < consumers; i++) {
+        received += __atomic_load_n(&bench->consumers[i].messages, __ATOMIC_RELAXED);
+    }
+    return received;
+}
+
+/*
+ * Chaos run (-K ms): instead of sleeping through the run, SIGKILLs a
+ * random worker every kill_ms on average (0.5 to 1.5 times that), at
+ * whatever point of a queue operation it happens to be, and starts a new
+ * one with the same index. The replacement adds to the same counters.
+ * Throughput is sampled every CHAOS_WINDOW_NS: a window without progress
+ * means the queue stalled on the dead worker's slots.
+ */
+void run_chaos(const bench_options *options, const bench_config *config, bench_shared *bench,
+               pid_t *pids, uint64_t stop, bench_result *result) {
+    int workers = options->producers + options->consumers;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    rng chaos;
+    rng_seed(&chaos, monotonic_ns() ^ (uint64_t)getpid());
+
+    uint64_t now = monotonic_ns();
+    uint64_t window_start = now;
+    uint64_t window_received = bench_received(bench, options->consumers);
+    uint64_t next_kill = now + ((uint64_t)options->kill_ms * 1000000ull / 2) +
+                         rng_below(&chaos, options->kill_ms) * 1000000ull;
+    result->worst_rate = -1.0;
+
+    while ((now = monotonic_ns()) < stop) {
+        uint64_t wake = next_kill < window_start + CHAOS_WINDOW_NS ? next_kill : window_start + CHAOS_WINDOW_NS;
+        wake = wake < stop ? wake : stop;
+        if (wake > now) {
+            struct timespec pause = {(time_t)((wake - now) / 1000000000ull), (long)((wake - now) % 1000000000ull)};
+            nanosleep(&pause, NULL);
+            now = monotonic_ns();
+        }
+
+        if (now >= next_kill && now < stop) {
+            int i = (int)rng_below(&chaos, (uint32_t)workers);
+            bool producer = i < options->producers;
+            int index = producer ? i : i - options->producers;
+            int cpu = options->pin && cpus > 0 ? (int)(i % cpus) : -1;
+            int shard = producer || options->shards == 1 ? -1 : index % (int)options->shards;
+
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+            pids[i] = spawn_worker(producer ? "./bin/producer" : "./bin/consumer",
+                                   index, config->batch, cpu, shard, options->corpus);
+            telemetry_reap(queue_telemetry(q));
+            result->kills++;
+            next_kill = now + ((uint64_t)options->kill_ms * 1000000ull / 2) +
+                        rng_below(&chaos, options->kill_ms) * 1000000ull;
+        }
+
+        if (now >= window_start + CHAOS_WINDOW_NS) {
+            uint64_t received = bench_received(bench, options->consumers);
+            double rate = (double)(received - window_received) / ((double)(now - window_start) / 1e9);
+            if (result->worst_rate < 0 || rate < result->worst_rate) {
+                result->worst_rate = rate;
+            }
+            if (received == window_received) {
+                result->stalled_windows++;
+            }
+            result->windows++;
+            window_start = now;
+            window_received = received;
+        }
+    }
+    if (result->worst_rate < 0) {
+        result->worst_rate = 0.0;
+    }
+}
+
+bench_result run_config(const bench_options *options, const bench_config *config) {
+    int workers = options->producers + options->consumers;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pid_t pids[2 * MAX_BENCH_WORKERS];
+    bench_result result;
+    memset(&result, 0, sizeof(result));
+
+    queue layout;
+    durable_flusher flusher;
+    event_server events;
+    queue_layout(&layout, options->slots, options->payload, options->ring_bytes,
+                 config->features | (options->events ? QUEUE_FEATURE_EVENTFD : 0), options->shards);
+    layout.hash_algo = (uint32_t)options->hash_algo;
+    if (options->file) {
+        size_t pending;
+        unlink(options->file);
+        setenv(QUEUE_FILE_ENV, options->file, 1);
+        q = durable_open(options->file, &layout, &pending);
+        durable_start(&flusher, q);
+    } else {
+        unsetenv(QUEUE_FILE_ENV);
+        q = (queue*)create_shared_memory(queue_shm_name(), layout.total_size);
+        queue_init(q, &layout);
+    }
+    bench_shared *bench = (bench_shared*)create_shared_memory(BENCH_SHM_NAME, sizeof(bench_shared));
+    if (options->events) {
+        event_server_start(&events, EVENT_SOCKET_NAME);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        bool producer = i < options->producers;
+        int cpu = options->pin && cpus > 0 ? (int)(i % cpus) : -1;
+        int index = producer ? i : i - options->producers;
+        int shard = producer || options->shards == 1 ? -1 : index % (int)options->shards;
+        pids[i] = spawn_worker(producer ? "./bin/producer" : "./bin/consumer",
+                               index, config->batch, cpu, shard, options->corpus);
+    }
+
+    /* All workers are mapped and waiting before the clock starts. */
+    uint64_t deadline = monotonic_ns() + READY_TIMEOUT_NS;
+    struct timespec poll = {0, START_POLL_NS};
+    while (atomic_load(&bench->ready) < workers) {
+        if (monotonic_ns() > deadline || waitpid(-1, NULL, WNOHANG) > 0) {
+            fprintf(stderr, "bench: workers did not start\n");
+            exit(EXIT_FAILURE);
+        }
+        nanosleep(&poll, NULL);
+    }
+
+    uint64_t start = monotonic_ns();
+    atomic_store(&bench->start, 1);
+    if (options->kill_ms > 0) {
+        run_chaos(options, config, bench, pids, start + (uint64_t)options->seconds * 1000000000ull, &result);
+    } else {
+        struct timespec duration = {(time_t)options->seconds, 0};
+        while (nanosleep(&duration, &duration) == -1 && errno == EINTR) {
+        }
+    }
+    uint64_t stop = monotonic_ns();
+
+    for (int i = 0; i < workers; i++) {
+        if (kill(pids[i], SIGUSR1) == -1) {
+            perror("kill");
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+
+    static uint64_t histogram[LATENCY_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+    for (int i = 0; i < options->producers; i++) {
+        result.sent += bench->producers[i].messages;
+    }
+    for (int i = 0; i < options->consumers; i++) {
+        result.received += bench->consumers[i].messages;
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            histogram[bucket] += bench->consumers[i].latency[bucket];
+        }
+    }
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (histogram[bucket] > 0) {
+            result.max_us = (double)latency_bucket_value(bucket) / 1e3;
+        }
+    }
+
+    result.seconds = (double)(stop - start) / 1e9;
+    result.p50_us = percentile_us(histogram, result.received, 0.50);
+    result.p90_us = percentile_us(histogram, result.received, 0.90);
+    result.p99_us = percentile_us(histogram, result.received, 0.99);
+    result.p999_us = percentile_us(histogram, result.received, 0.999);
+
+    for (size_t i = 0; i < q->shards; i++) {
+        result.repairs += (uint64_t)atomic_load(&queue_shard(q, i)->repaired_count);
+    }
+
+    if (options->file) {
+        durable_stop(&flusher);
+    }
+    if (options->events) {
+        event_server_stop(&events);
+    }
+    munmap(bench, sizeof(bench_shared));
+    munmap(q, q->total_size);
+    shm_unlink(BENCH_SHM_NAME);
+    if (options->file) {
+        unlink(options->file);
+    } else {
+        shm_unlink(queue_shm_name());
+    }
+    return result;
+}
+
+const char *mode_name(uint32_t features) {
+    if (features & QUEUE_FEATURE_BYTE_RING) {
+        return "bytes";
+    }
+    if (features & QUEUE_FEATURE_DURABLE) {
+        return (features & QUEUE_FEATURE_SYNC_COMMIT) ? "file-y" : "file";
+    }
+    return (features & QUEUE_FEATURE_BROADCAST) ? "bcast" : "slots";
+}
+
+void print_row(const bench_options *options, const bench_config *config, const bench_result *result) {
+    double rate = result->seconds > 0 ? (double)result->received / result->seconds : 0.0;
+
+    printf("%-12s %-5s %5zu %3zu %3d %3d %7zu %-6s %3s %12.0f %8.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+           config->label, mode_name(config->features),
+           config->batch, options->shards, options->producers, options->consumers, options->payload,
+           hash_algo_name(options->hash_algo), options->pin ? "yes" : "no",
+           rate, rate * options->message_bytes / 1e6,
+           result->p50_us, result->p90_us, result->p99_us, result->p999_us, result->max_us);
+}
+
+void append_csv(FILE *csv, const bench_options *options, const bench_config *config,
+                const bench_result *result) {
+    double rate = result->seconds > 0 ? (double)result->received / result->seconds : 0.0;
+
+    fprintf(csv, "%s,%s,%zu,%zu,%d,%d,%zu,%s,%s,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%" PRIu64 ",%" PRIu64 "\n",
+            config->label, mode_name(config->features),
+            config->batch, options->shards, options->producers, options->consumers, options->payload,
+            hash_algo_name(options->hash_algo), options->pin ? "yes" : "no",
+            rate, rate * options->message_bytes / 1e6,
+            result->p50_us, result->p90_us, result->p99_us, result->p999_us, result->max_us,
+            result->sent, result->received);
+}
+
+void print_usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-P producers] [-C consumers] [-t seconds] [-n slots] [-p payload]\n"
+            "          [-r ring_bytes] [-k batch] [-b | -B] [-a djb|crc32c] [-c] [-S]\n"
+            "          [-s shards] [-d file [-y]] [-e] [-R corpus] [-K ms] [-o results.csv] [-l label]\n"
+            "  -B  broadcast ring: msgs/s counts deliveries, each message once per consumer\n"
+            "  -d  durable slot ring in file (recreated and removed per run), group commits\n"
+            "  -y  with -d: producers wait until a commit covers each put\n"
+            "  -e  consumers wait in epoll on an eventfd (default label \"events\")\n"
+            "  -R  producers replay messages from a bin/corpus file (payload = its largest)\n"
+            "  -K  chaos: SIGKILL a random worker about every ms milliseconds and restart it\n"
+            "  -c  pin workers to CPUs round-robin\n"
+            "  -S  sweep: slots, slots with -k batch (8 if not given), byte ring\n"
+            "  -s  shards; consumer i is homed on shard i %% shards and steals from the rest\n",
+            program);
+}
+
+/* Also on the error exits, so that no private segment is left in /dev/shm. */
+void remove_private_queue(void) {
+    shm_unlink(queue_shm_name());
+}
+
+int main(int argc, char *argv[]) {
+    bench_options options = {1, 1, DEFAULT_SECONDS, DEFAULT_SLOTS, DEFAULT_PAYLOAD,
+                             DEFAULT_RING_BYTES, HASH_CRC32C, false, 1, NULL, false, NULL, 0.0, 0};
+    bench_config single = {NULL, 0, 1};
+    bool sweep = false;
+    const char *csv_path = "bench_results.csv";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "P:C:t:n:p:r:k:bBa:cs:d:yeR:K:So:l:")) != -1) {
+        switch (opt) {
+            case 'P': options.producers = atoi(optarg); break;
+            case 'C': options.consumers = atoi(optarg); break;
+            case 't': options.seconds = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'n': options.slots = strtoul(optarg, NULL, 10); break;
+            case 'p': options.payload = strtoul(optarg, NULL, 10); break;
+            case 'r': options.ring_bytes = strtoul(optarg, NULL, 10); break;
+            case 'k': single.batch = strtoul(optarg, NULL, 10); break;
+            case 'b': single.features |= QUEUE_FEATURE_BYTE_RING; break;
+            case 'B': single.features |= QUEUE_FEATURE_BROADCAST; break;
+            case 'a': options.hash_algo = parse_hash_algo(optarg); break;
+            case 'c': options.pin = true; break;
+            case 's': options.shards = strtoul(optarg, NULL, 10); break;
+            case 'd': options.file = optarg; break;
+            case 'y': single.features |= QUEUE_FEATURE_SYNC_COMMIT; break;
+            case 'e': options.events = true; break;
+            case 'R': options.corpus = optarg; break;
+            case 'K': options.kill_ms = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'S': sweep = true; break;
+            case 'o': csv_path = optarg; break;
+            case 'l': single.label = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Slots are sized for the largest recorded message; throughput in bytes uses the average. */
+    options.message_bytes = (double)(MESSAGE_HEADER + options.payload);
+    if (options.corpus) {
+        corpus replay;
+        corpus_open(&replay, options.corpus);
+        if (replay.header->min_payload < sizeof(uint64_t)) {
+            fprintf(stderr, "%s: payloads must be at least %zu bytes for the send time\n",
+                    options.corpus, sizeof(uint64_t));
+            return EXIT_FAILURE;
+        }
+        options.payload = replay.header->max_payload;
+        options.message_bytes = (double)replay.header->bytes / (double)replay.header->count;
+        corpus_close(&replay);
+    }
+
+    if (options.producers < 1 || options.producers > MAX_BENCH_WORKERS ||
+        options.consumers < 1 || options.consumers > MAX_BENCH_WORKERS ||
+        options.payload < sizeof(uint64_t) || options.payload > SIZE ||
+        options.slots == 0 || options.slots > MAX_CAPACITY ||
+        options.ring_bytes > MAX_BYTE_RING_SIZE || options.hash_algo == -1 ||
+        single.batch == 0 || single.batch > MAX_BATCH || options.seconds == 0 ||
+        options.shards == 0 || options.shards > MAX_SHARDS ||
+        ((single.features & QUEUE_FEATURE_BROADCAST) &&
+         ((single.features & QUEUE_FEATURE_BYTE_RING) || options.shards > 1 || sweep)) ||
+        (options.file && ((single.features & (QUEUE_FEATURE_BYTE_RING | QUEUE_FEATURE_BROADCAST)) || sweep)) ||
+        ((single.features & QUEUE_FEATURE_SYNC_COMMIT) && !options.file)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (options.file) {
+        single.features |= QUEUE_FEATURE_DURABLE;
+    }
+    size_t sweep_batch = single.batch > 1 ? single.batch : 8;
+    bench_config configs[3] = {
+        {"slots", 0, 1},
+        {"slots-batch", 0, sweep_batch},
+        {"bytes", QUEUE_FEATURE_BYTE_RING, 1},
+    };
+    if (!single.label) {
+        single.label = options.kill_ms ? "chaos" : options.corpus ? "replay" :
+                       options.events ? "events" : mode_name(single.features);
+    }
+    /* A queue of our own, inherited by the workers: main's may be running. */
+    char shm_name[64];
+    snprintf(shm_name, sizeof(shm_name), "%s.bench.%d", QUEUE_SHM_NAME, (int)getpid());
+    setenv(QUEUE_SHM_ENV, shm_name, 1);
+    atexit(remove_private_queue);
+
+    const bench_config *runs = sweep ? configs : &single;
+    size_t run_count = sweep ? 3 : 1;
+
+    FILE *csv = fopen(csv_path, "a");
+    if (!csv) {
+        perror("Failed to open CSV file");
+    } else if (ftell(csv) == 0) {
+        fprintf(csv, "label,mode,batch,shards,producers,consumers,payload,checksum,pinned,msgs_per_s,"
+                     "mb_per_s,lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,sent,received\n");
+    }
+
+    printf("%-12s %-5s %5s %3s %3s %3s %7s %-6s %3s %12s %8s %9s %9s %9s %9s %9s\n",
+           "label", "mode", "batch", "S", "P", "C", "payload", "hash", "pin", "msgs/s", "MB/s",
+           "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    for (size_t i = 0; i < run_count; i++) {
+        bench_result result = run_config(&options, &runs[i]);
+        print_row(&options, &runs[i], &result);
+        if (options.kill_ms) {
+            printf("  chaos: %" PRIu64 " workers killed, %" PRIu64 " slots repaired, worst 1 s window %.0f msgs/s, "
+                   "%u of %u windows without progress\n", result.kills, result.repairs, result.worst_rate,
+                   result.stalled_windows, result.windows);
+        }
+        if (csv) {
+            append_csv(csv, &options, &runs[i], &result);
+        }
+    }
+
+    if (csv) {
+        fclose(csv);
+        printf("Results appended to %s\n", csv_path);
+    }
+    return EXIT_SUCCESS;
+}
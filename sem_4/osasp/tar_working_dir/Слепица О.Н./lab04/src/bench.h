@@ -0,0 +1,92 @@
+#ifndef LAB04_BENCH_H
+#define LAB04_BENCH_H
+
+#include "header.h"
+#include <sched.h>
+
+#define BENCH_SHM_NAME "message_queue_bench"
+#define MAX_BENCH_WORKERS 32
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BITS)
+#define START_POLL_NS 1000000L
+
+/*
+ * Per-worker counters for the benchmark. Each worker writes only its own
+ * entry, so no atomics are needed; bin/bench reads them after waitpid().
+ * Latencies go into a log-linear histogram: 16 sub-buckets per power of
+ * two, i.e. within ~6% of the real value.
+ */
+typedef struct {
+    alignas(CACHE_LINE) uint64_t messages;
+    uint64_t latency[LATENCY_BUCKETS];
+} bench_worker;
+
+typedef struct {
+    atomic_int ready;
+    atomic_int start;
+    bench_worker producers[MAX_BENCH_WORKERS];
+    bench_worker consumers[MAX_BENCH_WORKERS];
+} bench_shared;
+
+size_t latency_bucket(uint64_t ns) {
+    if (ns < (1u << LATENCY_SUB_BITS)) {
+        return (size_t)ns;
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    size_t sub = (size_t)(ns >> (exponent - LATENCY_SUB_BITS)) & ((1u << LATENCY_SUB_BITS) - 1);
+    return ((size_t)(exponent - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+/* Lower bound of a bucket, the inverse of latency_bucket(). */
+uint64_t latency_bucket_value(size_t bucket) {
+    if (bucket < (1u << LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+    int exponent = (int)(bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1u << LATENCY_SUB_BITS) - 1);
+    return ((1ull << LATENCY_SUB_BITS) + sub) << (exponent - LATENCY_SUB_BITS);
+}
+
+void bench_record_latency(bench_worker *worker, uint64_t sent_ns) {
+    uint64_t now = monotonic_ns();
+    worker->latency[latency_bucket(now > sent_ns ? now - sent_ns : 0)]++;
+    worker->messages++;
+}
+
+void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity");
+    }
+}
+
+bench_shared *bench_attach() {
+    int fd = shm_open(BENCH_SHM_NAME, O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror("shm_open bench");
+        exit(EXIT_FAILURE);
+    }
+
+    void *ptr = mmap(NULL, sizeof(bench_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap bench");
+        exit(EXIT_FAILURE);
+    }
+
+    close(fd);
+    return (bench_shared *)ptr;
+}
+
+/* Reports in and waits until bin/bench starts the clock (or stops the run). */
+void bench_wait_start(bench_shared *bench) {
+    struct timespec poll = {0, START_POLL_NS};
+
+    atomic_fetch_add(&bench->ready, 1);
+    while (!atomic_load(&bench->start) && !terminate) {
+        nanosleep(&poll, NULL);
+    }
+}
+
+#endif // LAB04_BENCH_H
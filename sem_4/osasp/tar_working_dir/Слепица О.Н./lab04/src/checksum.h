@@ -0,0 +1,111 @@
+#ifndef LAB04_CHECKSUM_H
+#define LAB04_CHECKSUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u
+
+/*
+ * CRC32C (Castagnoli). crc32c() picks the SSE4.2 crc32 instruction when
+ * the CPU has it and falls back to slicing-by-8 tables otherwise. Both
+ * take and return the finished CRC, so calls can be chained over several
+ * buffers: crc32c(crc32c(0, a, n), b, m) == crc32c(0, a ++ b, n + m).
+ */
+
+static uint32_t crc32c_table[8][256];
+static bool crc32c_table_ready = false;
+static int crc32c_use_hw = -1;
+
+void crc32c_init_table() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+    crc32c_table_ready = true;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (!crc32c_table_ready) {
+        crc32c_init_table();
+    }
+
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t crc64 = ~crc;
+
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+
+    uint32_t crc32 = (uint32_t)crc64;
+    while (len--) {
+        crc32 = _mm_crc32_u8(crc32, *p++);
+    }
+    return ~crc32;
+}
+#endif
+
+bool crc32c_hw_available() {
+#ifdef HAVE_CRC32C_SSE42
+    if (crc32c_use_hw == -1) {
+        __builtin_cpu_init();
+        crc32c_use_hw = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    return crc32c_use_hw == 1;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+#ifdef HAVE_CRC32C_SSE42
+    if (crc32c_hw_available()) {
+        return crc32c_hw(crc, data, len);
+    }
+#endif
+    return crc32c_sw(crc, data, len);
+}
+
+#endif // LAB04_CHECKSUM_H
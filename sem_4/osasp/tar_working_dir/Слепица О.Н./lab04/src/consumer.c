@@ -1,61 +1,42 @@
-#include "header.h"
+#include "consumer.h"
 
 queue *q;
-sem_t *mutex;
-sem_t *free_space;
-sem_t *items;
-volatile sig_atomic_t terminate = 0;
+_Thread_local volatile sig_atomic_t terminate = 0;
 
-void print_message(const message *msg, int extracted_count) {
-    printf("CONSUMER %d: TYPE=%d HASH=%04X SIZE=%d EXTRACTED=%d\n", 
-           getpid(), msg->type, msg->hash, msg->size == 0 ? 256 : msg->size, 
-           extracted_count);
-}
+int main(int argc, char *argv[]) {
+    worker_options options = parse_worker_options(argc, argv);
+    size_t batch = options.batch;
+    initialize();
+    if (!telemetry_join(queue_telemetry(q), false)) {
+        cleanup();
+        return EXIT_FAILURE;
+    }
 
-void extract_message(message *msg) {
-    *msg = q->buffer[q->head];
-    
-    q->head = (q->head + 1) % BUFFER_SIZE;
-    
-    q->extracted_count++;
-}
+    subscription sub;
+    if (!subscribe(&sub, options.shard_mask, options.steal)) {
+        telemetry_leave(queue_telemetry(q), false);
+        cleanup();
+        return EXIT_FAILURE;
+    }
 
-int main() {
-    initialize();
-    
-    printf("Consumer started (PID: %d)\n", getpid());
-    
-    while (!terminate) {
-        int value;
-        if (sem_getvalue(items, &value) == 0 && value == 0) {
-            fprintf(stderr, "Consumer (PID: %d) waiting: queue is empty\n", getpid());
-        }
-        
-        sem_wait(items);
-        if (terminate) {
-            sem_post(items);
-            break;
-        }
-        
-        sem_wait(mutex);
-        
-        message msg;
-        extract_message(&msg);
-        int current_count = q->extracted_count;
-        
-        sem_post(mutex);
-        
-        sem_post(free_space);
-        
-        verify_hash(&msg);
-        
-        print_message(&msg, current_count);
-        
-        sleep(2 + rand() % 3);
+    if (options.cpu >= 0) {
+        pin_to_cpu(options.cpu);
+    }
+    if (options.bench_index >= 0 && options.bench_index < MAX_BENCH_WORKERS) {
+        bench_shared *bench = bench_attach();
+        bench_wait_start(bench);
+        consumer_benchmark(&bench->consumers[options.bench_index], &sub, batch);
+        unsubscribe(&sub);
+        munmap(bench, sizeof(bench_shared));
+        telemetry_leave(queue_telemetry(q), false);
+        cleanup();
+        return 0;
     }
-    
-    printf("Consumer (PID: %d) terminating\n", getpid());
+
+    run_consumer(&sub, batch);
+    unsubscribe(&sub);
+    telemetry_leave(queue_telemetry(q), false);
     cleanup();
-    
+
     return 0;
 }
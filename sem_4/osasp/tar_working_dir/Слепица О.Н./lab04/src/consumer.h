@@ -0,0 +1,418 @@
+#ifndef LAB04_CONSUMER_H
+#define LAB04_CONSUMER_H
+
+#include "header.h"
+#include "bench.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+typedef void (*message_handler)(message *msg, int extracted_count, void *context);
+
+/*
+ * Shards this consumer reads; with steal set it also drains the others when
+ * its own are empty. In broadcast mode reader is this consumer's cursor.
+ */
+typedef struct {
+    uint64_t mask;
+    bool steal;
+    size_t next;
+    cursor *reader;
+} subscription;
+
+void print_message(const message *msg, int extracted_count) {
+    printf("CONSUMER %d: TYPE=%d HASH=%04X SIZE=%d EXTRACTED=%d\n",
+           worker_id(), msg->type, msg->hash, msg->size == 0 ? 256 : msg->size,
+           extracted_count);
+}
+
+void verify_and_print(message *msg, int extracted_count, void *context) {
+    verify_hash(msg);
+    print_message(msg, extracted_count);
+}
+
+/* Benchmark mode: latency is taken from the send timestamp in the payload. */
+void check_and_record(message *msg, int extracted_count, void *context) {
+    uint64_t sent;
+    memcpy(&sent, msg->data, sizeof(sent));
+    verify_hash(msg);
+    bench_record_latency((bench_worker *)context, sent);
+}
+
+/* Byte-ring mode: the record is checked where it lies, then released. */
+void handle_record(queue *shard, message *msg, size_t len, message_handler handle, void *context) {
+    int current_count = atomic_fetch_add(&shard->extracted_count, 1) + 1;
+    if (len < MESSAGE_HEADER || len != message_length(msg)) {
+        fprintf(stderr, "BAD RECORD LENGTH: %zu\n", len);
+    } else {
+        handle(msg, current_count, context);
+    }
+
+    stats_count(shard, 1, len);
+    ring_release(queue_bytes(shard), msg);
+}
+
+void handle_batch(queue *shard, message *msgs, size_t got, int last_count,
+                  message_handler handle, void *context) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < got; i++) {
+        bytes += message_length(&msgs[i]);
+        handle(&msgs[i], last_count - (int)(got - 1 - i), context);
+    }
+    stats_count(shard, got, bytes);
+}
+
+/*
+ * Broadcast mode: the messages are handled where they lie, shared with the
+ * other subscribers. Holes left by producers that died are passed over.
+ */
+void handle_broadcast(cursor *reader, message **msgs, size_t got, message_handler handle, void *context) {
+    int last_count = atomic_fetch_add(&q->extracted_count, (int)got) + (int)got;
+    size_t bytes = 0;
+    for (size_t i = 0; i < got; i++) {
+        if (msgs[i]->algo == MESSAGE_HOLE) {
+            continue;
+        }
+        bytes += message_length(msgs[i]);
+        handle(msgs[i], last_count - (int)(got - 1 - i), context);
+    }
+    stats_count(q, got, bytes);
+    broadcast_release(q, reader, got);
+}
+
+int take_broadcast(cursor *reader, size_t batch, message_handler handle, void *context) {
+    message *msgs[MAX_BATCH];
+    size_t got = broadcast_peek_wait(q, reader, msgs, batch);
+    if (got == 0) {
+        return -1;
+    }
+    handle_broadcast(reader, msgs, got, handle, context);
+    return (int)got;
+}
+
+/* Blocking read from one shard. Returns the number of messages handled or -1. */
+int take_blocking(queue *shard, size_t batch, message_handler handle, void *context) {
+    if (queue_byte_mode(q)) {
+        size_t len;
+        message *msg = ring_peek_wait(shard, &len);
+        if (msg == NULL) {
+            return -1;
+        }
+        handle_record(shard, msg, len, handle, context);
+        return 1;
+    }
+
+    message msgs[MAX_BATCH];
+    size_t got;
+    int last_count = queue_get_batch(shard, msgs, batch, &got);
+    if (last_count == -1) {
+        return -1;
+    }
+    handle_batch(shard, msgs, got, last_count, handle, context);
+    return (int)got;
+}
+
+/* Non-blocking read from one shard: one record, or up to batch slots. */
+size_t take_from(queue *shard, size_t batch, message_handler handle, void *context) {
+    if (queue_byte_mode(q)) {
+        size_t len;
+        message *msg = ring_peek(shard, &len);
+        if (msg == NULL) {
+            return 0;
+        }
+        handle_record(shard, msg, len, handle, context);
+        return 1;
+    }
+
+    message msgs[MAX_BATCH];
+    size_t got = queue_try_get_batch(shard, msgs, batch);
+    if (got == 0) {
+        return 0;
+    }
+    queue_notify_many(&shard->space_seq, &shard->full_waiters, got);
+    int last_count = atomic_fetch_add(&shard->extracted_count, (int)got) + (int)got;
+    handle_batch(shard, msgs, got, last_count, handle, context);
+    return got;
+}
+
+/* One pass over the subscribed shards (round-robin start), then over the rest if stealing. */
+size_t take_any(subscription *sub, size_t batch, message_handler handle, void *context) {
+    size_t shards = q->shards;
+
+    for (int pass = 0; pass < (sub->steal ? 2 : 1); pass++) {
+        for (size_t i = 0; i < shards; i++) {
+            size_t index = (sub->next + i) % shards;
+            bool own = (sub->mask >> index) & 1;
+            if (own != (pass == 0)) {
+                continue;
+            }
+
+            size_t got = take_from(queue_shard(q, index), batch, handle, context);
+            if (got > 0) {
+                sub->next = index + 1;
+                return got;
+            }
+        }
+    }
+    return 0;
+}
+
+/* After a wait without progress: repair passes over the shards this consumer reads. */
+void repair_subscription(subscription *sub) {
+    if (sub->reader) {
+        queue_repair(q, sub->reader);
+        return;
+    }
+    for (size_t i = 0; i < q->shards; i++) {
+        if (sub->steal || ((sub->mask >> i) & 1)) {
+            queue_repair(queue_shard(q, i), NULL);
+        }
+    }
+}
+
+/* Blocking take_any(): spins, then sleeps on the doorbell shared by all shards. */
+int wait_any(subscription *sub, size_t batch, message_handler handle, void *context) {
+    for (int spin = 0; ; spin++) {
+        size_t got = take_any(sub, batch, handle, context);
+        if (got > 0) {
+            return (int)got;
+        }
+        if (terminate) {
+            return -1;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&q->doorbell_seq);
+        atomic_fetch_add(&q->doorbell_waiters, 1);
+        got = take_any(sub, batch, handle, context);
+        if (got == 0) {
+            futex_wait(&q->doorbell_seq, seen);
+        }
+        atomic_fetch_sub(&q->doorbell_waiters, 1);
+        if (got > 0) {
+            return (int)got;
+        }
+        repair_subscription(sub);
+    }
+}
+
+bool shard_empty(queue *shard) {
+    if (queue_byte_mode(q)) {
+        byte_ring *bytes = queue_bytes(shard);
+        return atomic_load(&bytes->head) == atomic_load(&bytes->tail);
+    }
+    return queue_length(shard) == 0;
+}
+
+bool subscription_empty(const subscription *sub) {
+    if (sub->reader) {
+        return atomic_load(&sub->reader->position) == atomic_load(&q->tail);
+    }
+    for (size_t i = 0; i < q->shards; i++) {
+        if (((sub->mask >> i) & 1) && !shard_empty(queue_shard(q, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* A consumer of exactly one shard without stealing sleeps on that shard's own futex words. */
+queue *single_shard(const subscription *sub) {
+    if (sub->steal || (sub->mask & (sub->mask - 1)) != 0) {
+        return NULL;
+    }
+    return queue_shard(q, (size_t)__builtin_ctzll(sub->mask));
+}
+
+int take(subscription *sub, size_t batch, message_handler handle, void *context) {
+    if (sub->reader) {
+        return take_broadcast(sub->reader, batch, handle, context);
+    }
+
+    queue *home = single_shard(sub);
+    return home ? take_blocking(home, batch, handle, context)
+                : wait_any(sub, batch, handle, context);
+}
+
+/* Non-blocking take(): 0 when the subscribed shards are empty. */
+size_t take_now(subscription *sub, size_t batch, message_handler handle, void *context) {
+    if (sub->reader) {
+        message *msgs[MAX_BATCH];
+        size_t got = broadcast_peek(q, sub->reader, msgs, batch);
+        if (got > 0) {
+            handle_broadcast(sub->reader, msgs, got, handle, context);
+        }
+        return got;
+    }
+    return take_any(sub, batch, handle, context);
+}
+
+/* True while another broadcast subscriber has messages left to read. */
+bool others_behind(const cursor *self) {
+    cursor_table *table = queue_cursors(q);
+    size_t tail = atomic_load(&q->tail);
+
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        cursor *reader = &table->cursors[i];
+        if (reader != self && atomic_load(&reader->owner) != 0 && atomic_load(&reader->position) != tail) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Event mode (queue started with -e): a single epoll loop instead of a
+ * blocked read, the way a service would also watch its sockets. The
+ * eventfd reports that the queue went non-empty; with pace, a timerfd
+ * spaces out the messages as the sleep() of the blocking loop does.
+ * Returns once terminate is set.
+ *
+ * Every wake drains the eventfd (it is nonblocking) and re-arms
+ * event_armed before the queues are checked again, so a readable eventfd
+ * means a publish that no consumer has seen yet. The eventfd is shared:
+ * when one consumer takes a message the others need not wake for it, but
+ * every broadcast subscriber has to, so a subscriber leaves the counter to
+ * the last one while another cursor still lags behind tail. While idle
+ * the wait times out as a futex wait does, for the repair pass.
+ */
+void run_event_loop(subscription *sub, size_t batch, message_handler handle, void *context, bool pace) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd == -1 || timer_fd == -1) {
+        perror("epoll/timerfd");
+        return;
+    }
+
+    struct epoll_event ev = {EPOLLIN | EPOLLET, {.fd = queue_event_fd}};
+    struct epoll_event tick = {EPOLLIN, {.fd = timer_fd}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, queue_event_fd, &ev) == -1 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &tick) == -1) {
+        perror("epoll_ctl");
+        return;
+    }
+
+    bool pacing = false;
+    while (!terminate) {
+        if (!pacing) {
+            if (take_now(sub, batch, handle, context) > 0) {
+                if (pace) {
+                    struct itimerspec delay = {{0, 0}, {2 + rand() % 3, 0}};
+                    timerfd_settime(timer_fd, 0, &delay, NULL);
+                    pacing = true;
+                }
+                continue;
+            }
+
+            atomic_store(&q->event_armed, 1);
+            if (!subscription_empty(sub)) {
+                continue;
+            }
+            if (pace) {
+                fprintf(stderr, "Consumer (PID: %d) waiting: queue is empty\n", worker_id());
+            }
+        }
+
+        struct epoll_event events[2];
+        int ready = epoll_wait(epoll_fd, events, 2, pacing ? -1 : (int)(FUTEX_TIMEOUT_NS / 1000000));
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        if (ready == 0) {
+            repair_subscription(sub);
+        }
+
+        uint64_t expirations;
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.fd == queue_event_fd) {
+                if (sub->reader && others_behind(sub->reader)) {
+                    continue;
+                }
+                uint64_t count;
+                while (read(queue_event_fd, &count, sizeof(count)) == sizeof(count)) {
+                }
+                if (errno != EAGAIN) {
+                    perror("read eventfd");
+                }
+                atomic_store(&q->event_armed, 1);
+            } else if (events[i].data.fd == timer_fd) {
+                pacing = false;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+                    perror("read timerfd");
+                }
+            }
+        }
+    }
+
+    close(timer_fd);
+    close(epoll_fd);
+}
+
+/* Benchmark mode: no sleeps and no output. */
+void consumer_benchmark(bench_worker *stats, subscription *sub, size_t batch) {
+    if (queue_event_fd != -1) {
+        run_event_loop(sub, batch, check_and_record, stats, false);
+        return;
+    }
+    while (!terminate) {
+        if (take(sub, batch, check_and_record, stats) == -1) {
+            break;
+        }
+    }
+}
+
+/*
+ * Sets sub up to read the shards in mask (all of them if 0), taking a
+ * broadcast cursor when the queue has them. False when all are taken.
+ */
+bool subscribe(subscription *sub, uint64_t mask, bool steal) {
+    uint64_t all = q->shards == 64 ? ~0ull : (1ull << q->shards) - 1;
+    sub->mask = (mask & all) ? (mask & all) : all;
+    sub->steal = steal;
+    sub->next = 0;
+    sub->reader = NULL;
+    if (queue_broadcast_mode(q) && !(sub->reader = broadcast_subscribe(q))) {
+        fprintf(stderr, "Consumer (PID: %d): all %d broadcast cursors are taken\n", worker_id(), MAX_SUBSCRIBERS);
+        return false;
+    }
+    return true;
+}
+
+void unsubscribe(subscription *sub) {
+    if (sub->reader) {
+        broadcast_unsubscribe(q, sub->reader);
+        sub->reader = NULL;
+    }
+}
+
+/* Interactive consumer: a message (or a batch) every 2-4 s until terminate is set. */
+void run_consumer(subscription *sub, size_t batch) {
+    printf("Consumer started (PID: %d)\n", worker_id());
+    if (batch > 1 && queue_byte_mode(q)) {
+        fprintf(stderr, "Consumer (PID: %d): batches are for slot mode, reading one record at a time\n", worker_id());
+    }
+
+    if (queue_event_fd != -1) {
+        run_event_loop(sub, batch, verify_and_print, NULL, true);
+    }
+    while (!terminate) {
+        if (subscription_empty(sub)) {
+            fprintf(stderr, "Consumer (PID: %d) waiting: queue is empty\n", worker_id());
+        }
+
+        if (take(sub, batch, verify_and_print, NULL) == -1) {
+            break;
+        }
+
+        sleep(2 + rand() % 3);
+    }
+
+    printf("Consumer (PID: %d) terminating\n", worker_id());
+}
+
+#endif // LAB04_CONSUMER_H
@@ -0,0 +1,94 @@
+#include "header.h"
+#include "generator.h"
+#include "corpus.h"
+
+#define DEFAULT_COUNT 100000
+#define DEFAULT_MIN_PAYLOAD 8
+
+queue *q;
+_Thread_local volatile sig_atomic_t terminate = 0;
+
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-n count] [-m min_payload] [-p max_payload] [-a djb|crc32c] [-o file]\n", program);
+    fprintf(stderr, "  -n  messages to write (default %d)\n", DEFAULT_COUNT);
+    fprintf(stderr, "  -m  smallest payload, at least 8 for bench latency stamps (default %d)\n", DEFAULT_MIN_PAYLOAD);
+    fprintf(stderr, "  -p  largest payload, up to %d (default %d)\n", SIZE, SIZE);
+    fprintf(stderr, "  -o  output file (default corpus.bin)\n");
+}
+
+/*
+ * Writes a corpus of random messages for bench -R: random type, payload
+ * size uniform in [min, max], printable payload, checksum filled in.
+ */
+int main(int argc, char *argv[]) {
+    unsigned long count = DEFAULT_COUNT;
+    unsigned long min_payload = DEFAULT_MIN_PAYLOAD;
+    unsigned long max_payload = SIZE;
+    int hash_algo = HASH_CRC32C;
+    const char *path = "corpus.bin";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:p:a:o:")) != -1) {
+        switch (opt) {
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'm': min_payload = strtoul(optarg, NULL, 10); break;
+            case 'p': max_payload = strtoul(optarg, NULL, 10); break;
+            case 'a': hash_algo = parse_hash_algo(optarg); break;
+            case 'o': path = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (count == 0 || min_payload == 0 || max_payload > SIZE || min_payload > max_payload || hash_algo == -1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    corpus_header header = {CORPUS_MAGIC, CORPUS_VERSION, (uint32_t)min_payload, (uint32_t)max_payload,
+                            (uint32_t)hash_algo, 0, count, 0};
+    if (fwrite(&header, sizeof(header), 1, out) != 1) {
+        perror("fwrite");
+        return EXIT_FAILURE;
+    }
+
+    rng generator;
+    rng_seed(&generator, monotonic_ns() ^ (uint64_t)getpid());
+    union {
+        message msg;
+        uint8_t bytes[CORPUS_RECORD(sizeof(message))];
+    } record;
+    message *msg = &record.msg;
+    for (unsigned long i = 0; i < count; i++) {
+        uint32_t size = (uint32_t)min_payload + rng_below(&generator, (uint32_t)(max_payload - min_payload + 1));
+        size_t len = MESSAGE_HEADER + size;
+
+        memset(&record, 0, sizeof(record));
+        msg->type = (uint8_t)rng_next(&generator);
+        msg->algo = (uint8_t)hash_algo;
+        msg->size = size == 256 ? 0 : (uint8_t)size;
+        fill_printable(&generator, msg->data, size);
+        msg->hash = calculate_hash(msg);
+
+        if (fwrite(record.bytes, CORPUS_RECORD(len), 1, out) != 1) {
+            perror("fwrite");
+            return EXIT_FAILURE;
+        }
+        header.bytes += len;
+    }
+
+    /* The total is known only at the end. */
+    if (fseek(out, 0, SEEK_SET) == -1 || fwrite(&header, sizeof(header), 1, out) != 1 || fclose(out) == EOF) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    printf("%lu messages, %" PRIu64 " bytes, payload %lu..%lu, %s, in %s\n",
+           count, header.bytes, min_payload, max_payload, hash_algo_name(hash_algo), path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#ifndef LAB04_CORPUS_H
+#define LAB04_CORPUS_H
+
+#include "header.h"
+
+#define CORPUS_MAGIC 0x4C34434Fu
+#define CORPUS_VERSION 1
+#define CORPUS_RECORD(len) (((size_t)(len) + 3) & ~(size_t)3)
+
+/*
+ * Corpus file for replay (bin/corpus writes it, bench -R reads it): this
+ * header, then count finished messages (hash included) packed back to
+ * back, each padded to 4 bytes so that it can be read in place.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t min_payload;
+    uint32_t max_payload;
+    uint32_t hash_algo;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t bytes;
+} corpus_header;
+
+/* A mapped corpus; next walks the records and wraps around at end. */
+typedef struct {
+    const corpus_header *header;
+    const uint8_t *first;
+    const uint8_t *end;
+    const uint8_t *next;
+    size_t map_size;
+} corpus;
+
+/*
+ * Maps path read-only and checks every record against the header, which
+ * also pulls the whole file into the page cache before the clock starts.
+ * Exits on a file that is not a corpus.
+ */
+void corpus_open(corpus *c, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)st.st_size <= sizeof(corpus_header)) {
+        fprintf(stderr, "%s: not a message corpus\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    c->header = (const corpus_header *)map;
+    c->first = (const uint8_t *)map + sizeof(corpus_header);
+    c->end = (const uint8_t *)map + st.st_size;
+    c->next = c->first;
+    c->map_size = (size_t)st.st_size;
+
+    const corpus_header *header = c->header;
+    uint64_t found = 0;
+    const uint8_t *record = c->first;
+    bool ok = header->magic == CORPUS_MAGIC && header->version == CORPUS_VERSION &&
+              header->min_payload >= 1 && header->min_payload <= header->max_payload &&
+              header->max_payload <= SIZE && header->count > 0;
+    while (ok && record < c->end) {
+        const message *msg = (const message *)record;
+        size_t len = message_length(msg);
+        ok = (size_t)(c->end - record) >= len && len >= MESSAGE_HEADER + header->min_payload &&
+             len <= MESSAGE_HEADER + header->max_payload &&
+             msg->algo < HASH_ALGO_COUNT;
+        record += CORPUS_RECORD(len);
+        found++;
+    }
+    if (!ok || found != header->count) {
+        fprintf(stderr, "%s: not a message corpus\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+const message *corpus_next(corpus *c) {
+    if (c->next >= c->end) {
+        c->next = c->first;
+    }
+    const message *msg = (const message *)c->next;
+    c->next += CORPUS_RECORD(message_length(msg));
+    return msg;
+}
+
+void corpus_close(corpus *c) {
+    munmap((void *)c->header, c->map_size);
+}
+
+#endif // LAB04_CORPUS_H
@@ -0,0 +1,298 @@
+#ifndef LAB04_DURABLE_H
+#define LAB04_DURABLE_H
+
+#include "header.h"
+#include <pthread.h>
+
+#define DURABLE_IDLE_NS 1000000L
+
+/*
+ * Durable mode (-d file): the segment is a regular file and a flusher
+ * thread in the owning process does group commits. One flush covers
+ * every message published or consumed since the previous one: it msyncs
+ * the rings, then writes head and tail into each shard's commit record
+ * and msyncs that. Producers and consumers run exactly as in shm mode;
+ * by default nobody waits for a flush, so a put is durable only once a
+ * later commit happens to cover it. With QUEUE_FEATURE_SYNC_COMMIT (-y)
+ * a producer waits after each put or batch until a commit covers it, and
+ * one flush releases every producer waiting at the time.
+ *
+ * After a restart, messages published after the last commit are lost and
+ * those consumed after it are delivered again, except where a producer
+ * already reused the slot: recovery skips that prefix.
+ */
+typedef struct {
+    queue *segment;
+    atomic_bool stop;
+    pthread_t thread;
+    uint64_t generation;
+    uint64_t commits;
+    size_t heads[MAX_SHARDS];
+    size_t tails[MAX_SHARDS];
+} durable_flusher;
+
+uint32_t commit_crc(const commit_record *record) {
+    return crc32c(0, record, offsetof(commit_record, crc));
+}
+
+/* The newer of the two commit records that passes its checksum, or NULL. */
+const commit_record *durable_last_commit(const queue *ring) {
+    const commit_record *last = NULL;
+
+    for (int i = 0; i < 2; i++) {
+        const commit_record *record = &ring->commits[i];
+        if (record->generation != 0 && record->crc == commit_crc(record) &&
+            (!last || record->generation > last->generation)) {
+            last = record;
+        }
+    }
+    return last;
+}
+
+/*
+ * The slot still holds the message published at pos, whole: either not
+ * consumed yet (sequence pos + 1) or consumed (pos + capacity) with the
+ * consumer's claim still on it. A producer of the next lap replaces that
+ * claim before it writes anything into the slot.
+ */
+bool durable_slot_intact(queue *ring, size_t pos) {
+    slot *cell = queue_slot(ring, pos);
+    const message *msg = slot_message(cell);
+    size_t sequence = atomic_load(&cell->sequence);
+    uint64_t claim = atomic_load(&cell->claim);
+    bool held = sequence == pos + 1 ||
+                (sequence == pos + ring->capacity && claim_at(claim, pos) && (claim & CLAIM_CONSUMER));
+
+    return held && msg->algo < HASH_ALGO_COUNT &&
+           message_length(msg) <= MESSAGE_HEADER + ring->max_payload &&
+           calculate_hash(msg) == msg->hash;
+}
+
+/*
+ * Rebuilds a shard from its last commit: head and tail go back to the
+ * committed positions and the slots in between are marked full again.
+ * Slots are reused strictly in position order, so the consumed messages
+ * overwritten since the commit form a prefix of that range. Returns the
+ * number of messages waiting.
+ */
+size_t durable_recover(queue *ring) {
+    const commit_record *last = durable_last_commit(ring);
+    size_t head = last ? last->head : 0;
+    size_t tail = last ? last->tail : 0;
+
+    while (head < tail && !durable_slot_intact(ring, head)) {
+        head++;
+    }
+    for (size_t pos = head; pos < head + ring->capacity; pos++) {
+        slot_reset(ring, pos, pos < tail ? pos + 1 : pos);
+    }
+    atomic_store(&ring->head, head);
+    atomic_store(&ring->tail, tail);
+    atomic_store(&ring->empty_waiters, 0);
+    atomic_store(&ring->full_waiters, 0);
+    atomic_store(&ring->doorbell_waiters, 0);
+    atomic_store(&ring->commit_waiters, 0);
+    return tail - head;
+}
+
+/*
+ * Blocks until a commit record covers everything published in the shard
+ * so far, which includes the caller's last put. Returns false once
+ * terminate is set: the message is in the queue, but not known durable.
+ */
+bool durable_wait_commit(queue *ring) {
+    size_t target = atomic_load(&ring->tail);
+
+    for (;;) {
+        unsigned int seen = atomic_load(&ring->commit_seq);
+        const commit_record *last = durable_last_commit(ring);
+        if (last && last->tail >= target) {
+            return true;
+        }
+        if (terminate) {
+            return false;
+        }
+        atomic_fetch_add(&ring->commit_waiters, 1);
+        futex_wait(&ring->commit_seq, seen);
+        atomic_fetch_sub(&ring->commit_waiters, 1);
+    }
+}
+
+/* msync() of whole pages around [addr, addr + len). */
+void durable_sync(void *addr, size_t len) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(page - 1);
+    uintptr_t end = (uintptr_t)addr + len;
+
+    if (msync((void *)start, end - start, MS_SYNC) == -1) {
+        perror("msync");
+    }
+}
+
+/*
+ * One group commit over all shards. Returns how many positions head and
+ * tail moved together, 0 when there was nothing to commit.
+ */
+size_t durable_flush(durable_flusher *flusher) {
+    queue *segment = flusher->segment;
+    size_t heads[MAX_SHARDS], tails[MAX_SHARDS];
+    size_t moved = 0;
+
+    for (size_t i = 0; i < segment->shards; i++) {
+        queue *ring = queue_shard(segment, i);
+        size_t end = atomic_load(&ring->tail);
+        size_t tail = flusher->tails[i];
+        size_t head = flusher->heads[i];
+
+        /* Sequences only grow: published means at least pos + 1, consumed at least pos + capacity. */
+        while (tail < end &&
+               (intptr_t)(atomic_load_explicit(&queue_slot(ring, tail)->sequence, memory_order_acquire) -
+                          (tail + 1)) >= 0) {
+            tail++;
+        }
+        while (head < tail &&
+               (intptr_t)(atomic_load_explicit(&queue_slot(ring, head)->sequence, memory_order_acquire) -
+                          (head + ring->capacity)) >= 0) {
+            head++;
+        }
+
+        heads[i] = head;
+        tails[i] = tail;
+        moved += (head - flusher->heads[i]) + (tail - flusher->tails[i]);
+    }
+    if (moved == 0) {
+        return 0;
+    }
+
+    durable_sync(segment, segment->total_size);
+    flusher->generation++;
+    for (size_t i = 0; i < segment->shards; i++) {
+        queue *ring = queue_shard(segment, i);
+        commit_record *record = &ring->commits[flusher->generation & 1];
+        record->generation = flusher->generation;
+        record->head = heads[i];
+        record->tail = tails[i];
+        record->crc = commit_crc(record);
+        durable_sync(record, sizeof(*record));
+        queue_notify_many(&ring->commit_seq, &ring->commit_waiters, INT_MAX);
+    }
+    flusher->commits++;
+
+    memcpy(flusher->heads, heads, segment->shards * sizeof(size_t));
+    memcpy(flusher->tails, tails, segment->shards * sizeof(size_t));
+    return moved;
+}
+
+/* Commits back to back while there is work, otherwise polls every DURABLE_IDLE_NS. */
+void *durable_flusher_run(void *arg) {
+    durable_flusher *flusher = (durable_flusher *)arg;
+    struct timespec idle = {0, DURABLE_IDLE_NS};
+
+    while (!atomic_load(&flusher->stop)) {
+        if (durable_flush(flusher) == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    durable_flush(flusher);
+    return NULL;
+}
+
+void durable_start(durable_flusher *flusher, queue *segment) {
+    memset(flusher, 0, sizeof(*flusher));
+    flusher->segment = segment;
+    atomic_init(&flusher->stop, false);
+
+    /* Starts from the recovered positions, which may be past the last commit's head. */
+    for (size_t i = 0; i < segment->shards; i++) {
+        queue *ring = queue_shard(segment, i);
+        const commit_record *last = durable_last_commit(ring);
+        flusher->heads[i] = atomic_load(&ring->head);
+        flusher->tails[i] = atomic_load(&ring->tail);
+        if (last && last->generation > flusher->generation) {
+            flusher->generation = last->generation;
+        }
+    }
+
+    int err = pthread_create(&flusher->thread, NULL, durable_flusher_run, flusher);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Stops the thread after a last commit. */
+void durable_stop(durable_flusher *flusher) {
+    atomic_store(&flusher->stop, true);
+    pthread_join(flusher->thread, NULL);
+}
+
+/*
+ * Maps path as the queue segment. A durable queue file left by an earlier
+ * run is recovered with the geometry stored in it, and *pending receives
+ * the number of messages found; a missing or empty file is created from
+ * layout. Anything else in the file is refused rather than overwritten.
+ */
+queue *durable_open(const char *path, const queue *layout, size_t *pending) {
+    int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = layout->total_size;
+    bool existing = st.st_size > 0;
+    if (existing) {
+        if ((size_t)st.st_size < sizeof(queue)) {
+            fprintf(stderr, "%s: not a queue file\n", path);
+            exit(EXIT_FAILURE);
+        }
+        queue *header = mmap(NULL, sizeof(queue), PROT_READ, MAP_SHARED, fd, 0);
+        if (header == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        if (!queue_check(header, (size_t)st.st_size) || !(header->features & QUEUE_FEATURE_DURABLE)) {
+            fprintf(stderr, "%s: not a durable queue file\n", path);
+            exit(EXIT_FAILURE);
+        }
+        size = header->total_size;
+        munmap(header, sizeof(queue));
+    } else if (ftruncate(fd, (off_t)size) == -1) {
+        perror("ftruncate");
+        exit(EXIT_FAILURE);
+    }
+
+    queue *segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    *pending = 0;
+    if (existing) {
+        for (size_t i = 0; i < segment->shards; i++) {
+            *pending += durable_recover(queue_shard(segment, i));
+        }
+        /* Worker entries belong to processes of the previous run. */
+        memset(queue_telemetry(segment), 0, sizeof(telemetry));
+        /* Waiting for commits is up to this run, not the one that created the file. */
+        for (size_t i = 0; i < segment->shards; i++) {
+            queue *ring = queue_shard(segment, i);
+            ring->features = (ring->features & ~QUEUE_FEATURE_SYNC_COMMIT) |
+                             (layout->features & QUEUE_FEATURE_SYNC_COMMIT);
+        }
+    } else {
+        queue_init(segment, layout);
+        durable_sync(segment, size);
+    }
+    return segment;
+}
+
+#endif // LAB04_DURABLE_H
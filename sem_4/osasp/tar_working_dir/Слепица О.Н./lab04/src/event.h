@@ -0,0 +1,166 @@
+#ifndef LAB04_EVENT_H
+#define LAB04_EVENT_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define EVENT_SOCKET_NAME "lab04_message_queue"
+
+/*
+ * Event mode (-e): main owns an eventfd and hands it to every worker over
+ * a Unix socket in the abstract namespace (nothing to unlink afterwards).
+ * Producers write to it, consumers put it in their epoll set.
+ */
+typedef struct {
+    int listen_fd;
+    int event_fd;
+    pthread_t thread;
+} event_server;
+
+socklen_t event_address(struct sockaddr_un *addr, const char *name) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path + 1, name, sizeof(addr->sun_path) - 2);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr->sun_path + 1));
+}
+
+/* Sends fd as SCM_RIGHTS along with a one-byte payload. */
+int send_fd(int sock, int fd) {
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == -1 ? -1 : 0;
+}
+
+/* The descriptor sent by send_fd(), or -1. */
+int receive_fd(int sock) {
+    char byte;
+    struct iovec iov = {&byte, 1};
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    int fd = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) <= 0) {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return fd;
+}
+
+/* Accepts until event_server_stop() shuts the socket down; each client gets the eventfd. */
+void *event_server_run(void *arg) {
+    event_server *server = (event_server *)arg;
+
+    for (;;) {
+        int client = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        if (send_fd(client, server->event_fd) == -1) {
+            perror("sendmsg");
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+void event_server_start(event_server *server, const char *name) {
+    struct sockaddr_un addr;
+    socklen_t len = event_address(&addr, name);
+
+    server->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->event_fd == -1) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->listen_fd == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (bind(server->listen_fd, (struct sockaddr *)&addr, len) == -1 ||
+        listen(server->listen_fd, 16) == -1) {
+        perror("bind event socket");
+        exit(EXIT_FAILURE);
+    }
+
+    int err = pthread_create(&server->thread, NULL, event_server_run, server);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(EXIT_FAILURE);
+    }
+}
+
+void event_server_stop(event_server *server) {
+    shutdown(server->listen_fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+    close(server->event_fd);
+}
+
+/* Worker side: fetches the eventfd from main. */
+int event_connect(const char *name) {
+    struct sockaddr_un addr;
+    socklen_t len = event_address(&addr, name);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (connect(sock, (struct sockaddr *)&addr, len) == -1) {
+        perror("connect event socket");
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = receive_fd(sock);
+    close(sock);
+    if (fd == -1) {
+        fprintf(stderr, "event socket: no descriptor received\n");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+#endif // LAB04_EVENT_H
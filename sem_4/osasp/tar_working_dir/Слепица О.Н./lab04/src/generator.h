@@ -0,0 +1,181 @@
+#ifndef LAB04_GENERATOR_H
+#define LAB04_GENERATOR_H
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_FILL_AVX2 1
+#endif
+
+#define PRINTABLE_FIRST 32
+#define PRINTABLE_COUNT 95
+
+/*
+ * Message generator: xoshiro256** instead of rand(), which takes a lock
+ * on global state and costs a call per payload byte. Each producer
+ * (process or worker_host thread) owns its generator. rng_next() serves
+ * the scalar draws; payload bytes come from four more xoshiro256** streams
+ * stepped side by side in the lanes of an AVX2 register and mapped to
+ * printable characters in the same registers, 32 bytes per two steps.
+ * Without AVX2 the same mapping runs on the scalar stream, 4 bytes per
+ * step.
+ *
+ * Every character takes 16 random bits x and maps to
+ * PRINTABLE_FIRST + (x * 95 >> 16): each of the 95 values gets 689 or 690
+ * of the 65536 inputs, with no division or rejection loop.
+ */
+typedef struct {
+    uint64_t s[4];
+    alignas(32) uint64_t lanes[4][4];
+} rng;
+
+static int fill_use_avx2 = -1;
+
+uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(rng *r, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        r->s[i] = splitmix64(&seed);
+    }
+    for (int word = 0; word < 4; word++) {
+        for (int lane = 0; lane < 4; lane++) {
+            r->lanes[word][lane] = splitmix64(&seed);
+        }
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t rng_next(rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+/* Uniform in [0, n) by multiply-shift (Lemire), bias below 2^-32 * n. */
+uint32_t rng_below(rng *r, uint32_t n) {
+    return (uint32_t)(((rng_next(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+/* Four printable bytes out of one 64-bit draw. */
+static inline void printable_quad(uint64_t bits, uint8_t out[4]) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(PRINTABLE_FIRST + (((bits >> (16 * i)) & 0xFFFF) * PRINTABLE_COUNT >> 16));
+    }
+}
+
+void fill_printable_sw(rng *r, uint8_t *dst, size_t len) {
+    uint8_t quad[4];
+
+    while (len >= 4) {
+        printable_quad(rng_next(r), dst);
+        dst += 4;
+        len -= 4;
+    }
+    if (len > 0) {
+        printable_quad(rng_next(r), quad);
+        memcpy(dst, quad, len);
+    }
+}
+
+#ifdef HAVE_FILL_AVX2
+__attribute__((target("avx2")))
+static inline __m256i rotl64x4(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+/* One step of four xoshiro256** streams; the multiplications by 5 and 9 are shifts and adds. */
+__attribute__((target("avx2")))
+static inline __m256i xoshiro_x4(__m256i *s0, __m256i *s1, __m256i *s2, __m256i *s3) {
+    __m256i x5 = _mm256_add_epi64(_mm256_slli_epi64(*s1, 2), *s1);
+    __m256i rot = rotl64x4(x5, 7);
+    __m256i result = _mm256_add_epi64(_mm256_slli_epi64(rot, 3), rot);
+    __m256i t = _mm256_slli_epi64(*s1, 17);
+
+    *s2 = _mm256_xor_si256(*s2, *s0);
+    *s3 = _mm256_xor_si256(*s3, *s1);
+    *s1 = _mm256_xor_si256(*s1, *s2);
+    *s0 = _mm256_xor_si256(*s0, *s3);
+    *s2 = _mm256_xor_si256(*s2, t);
+    *s3 = rotl64x4(*s3, 45);
+    return result;
+}
+
+/* The 16-bit halves of two steps become 32 characters; packing reorders them, which is harmless here. */
+__attribute__((target("avx2")))
+void fill_printable_avx2(rng *r, uint8_t *dst, size_t len) {
+    __m256i s0 = _mm256_load_si256((const __m256i *)r->lanes[0]);
+    __m256i s1 = _mm256_load_si256((const __m256i *)r->lanes[1]);
+    __m256i s2 = _mm256_load_si256((const __m256i *)r->lanes[2]);
+    __m256i s3 = _mm256_load_si256((const __m256i *)r->lanes[3]);
+    const __m256i count = _mm256_set1_epi16(PRINTABLE_COUNT);
+    const __m256i first = _mm256_set1_epi8(PRINTABLE_FIRST);
+
+    while (len > 0) {
+        __m256i a = _mm256_mulhi_epu16(xoshiro_x4(&s0, &s1, &s2, &s3), count);
+        __m256i b = _mm256_mulhi_epu16(xoshiro_x4(&s0, &s1, &s2, &s3), count);
+        __m256i printable = _mm256_add_epi8(_mm256_packus_epi16(a, b), first);
+
+        if (len >= 32) {
+            _mm256_storeu_si256((__m256i *)dst, printable);
+            dst += 32;
+            len -= 32;
+        } else {
+            alignas(32) uint8_t tail[32];
+            _mm256_store_si256((__m256i *)tail, printable);
+            memcpy(dst, tail, len);
+            len = 0;
+        }
+    }
+
+    _mm256_store_si256((__m256i *)r->lanes[0], s0);
+    _mm256_store_si256((__m256i *)r->lanes[1], s1);
+    _mm256_store_si256((__m256i *)r->lanes[2], s2);
+    _mm256_store_si256((__m256i *)r->lanes[3], s3);
+}
+#endif
+
+bool fill_avx2_available() {
+#ifdef HAVE_FILL_AVX2
+    if (fill_use_avx2 == -1) {
+        __builtin_cpu_init();
+        fill_use_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return fill_use_avx2 == 1;
+#else
+    return false;
+#endif
+}
+
+/* len printable characters (32..126) into dst. */
+void fill_printable(rng *r, uint8_t *dst, size_t len) {
+#ifdef HAVE_FILL_AVX2
+    if (fill_avx2_available()) {
+        fill_printable_avx2(r, dst, len);
+        return;
+    }
+#endif
+    fill_printable_sw(r, dst, len);
+}
+
+#endif // LAB04_GENERATOR_H
@@ -0,0 +1,168 @@
+#include "header.h"
+#include "generator.h"
+
+#define DEFAULT_ROUNDS 1000000
+#define CHECK_STRING "123456789"
+#define CHECK_CRC32C 0xE3069283u
+
+queue *q;
+_Thread_local volatile sig_atomic_t terminate = 0;
+
+typedef uint16_t (*hash_fn)(const message *msg);
+
+/* hash_crc32c() with the implementation pinned instead of dispatched. */
+uint16_t hash_crc32c_with(const message *msg, uint32_t (*crc_fn)(uint32_t, const void *, size_t)) {
+    const uint8_t *bytes = (const uint8_t*)msg;
+    size_t after_hash = offsetof(message, hash) + sizeof(msg->hash);
+    
+    uint32_t crc = crc_fn(0, bytes, offsetof(message, hash));
+    crc = crc_fn(crc, bytes + after_hash, message_length(msg) - after_hash);
+    return (uint16_t)(crc ^ (crc >> 16));
+}
+
+uint16_t hash_crc32c_sw(const message *msg) {
+    return hash_crc32c_with(msg, crc32c_sw);
+}
+
+#ifdef HAVE_CRC32C_SSE42
+uint16_t hash_crc32c_hw(const message *msg) {
+    return hash_crc32c_with(msg, crc32c_hw);
+}
+#endif
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* Average ns per message; msgs holds 64 messages of the same size to defeat caching of one result. */
+double time_hash(hash_fn fn, const message *msgs, long rounds) {
+    volatile uint16_t sink = 0;
+    double start = now_ns();
+    
+    for (long i = 0; i < rounds; i++) {
+        sink ^= fn(&msgs[i & 63]);
+    }
+    (void)sink;
+    return (now_ns() - start) / (double)rounds;
+}
+
+/* Payload generation, the other per-message cost of a producer: ns per message of len bytes. */
+double time_fill_rand(uint8_t *dst, size_t len, long rounds) {
+    double start = now_ns();
+    for (long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < len; j++) {
+            dst[j] = (uint8_t)(32 + rand() % 95);
+        }
+    }
+    return (now_ns() - start) / (double)rounds;
+}
+
+double time_fill(void (*fill)(rng *, uint8_t *, size_t), rng *r, uint8_t *dst, size_t len, long rounds) {
+    double start = now_ns();
+    for (long i = 0; i < rounds; i++) {
+        fill(r, dst, len);
+    }
+    return (now_ns() - start) / (double)rounds;
+}
+
+bool self_check() {
+    bool ok = crc32c_sw(0, CHECK_STRING, strlen(CHECK_STRING)) == CHECK_CRC32C;
+    
+#ifdef HAVE_CRC32C_SSE42
+    if (crc32c_hw_available()) {
+        uint8_t buffer[1024];
+        for (size_t i = 0; i < sizeof(buffer); i++) {
+            buffer[i] = (uint8_t)rand();
+        }
+        ok = ok && crc32c_hw(0, CHECK_STRING, strlen(CHECK_STRING)) == CHECK_CRC32C;
+        for (size_t len = 0; len <= sizeof(buffer) && ok; len += 7) {
+            ok = crc32c_hw(0, buffer, len) == crc32c_sw(0, buffer, len);
+        }
+    }
+#endif
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    static const int sizes[] = {1, 8, 32, 64, 128, 256};
+    long rounds = DEFAULT_ROUNDS;
+    static message msgs[64];
+    
+    if (argc > 1) {
+        rounds = strtol(argv[1], NULL, 10);
+    }
+    if (rounds <= 0) {
+        fprintf(stderr, "Usage: %s [rounds_per_size]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    srand(1);
+    if (!self_check()) {
+        fprintf(stderr, "crc32c self-check failed\n");
+        return EXIT_FAILURE;
+    }
+    
+    bool hw = crc32c_hw_available();
+    printf("Rounds per size: %ld, SSE4.2 crc32: %s\n", rounds, hw ? "yes" : "no");
+    printf("%8s %12s %12s %12s %10s\n", "payload", "djb ns", "crc32c-sw ns", "crc32c-hw ns", "best gain");
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int i = 0; i < 64; i++) {
+            msgs[i].type = (uint8_t)rand();
+            msgs[i].algo = HASH_CRC32C;
+            msgs[i].hash = 0;
+            msgs[i].size = sizes[s] == 256 ? 0 : (uint8_t)sizes[s];
+            for (int j = 0; j < sizes[s]; j++) {
+                msgs[i].data[j] = (uint8_t)(32 + rand() % 95);
+            }
+        }
+        
+        double djb = time_hash(hash_djb, msgs, rounds);
+        double sw = time_hash(hash_crc32c_sw, msgs, rounds);
+        double best = sw;
+        
+        printf("%8d %12.1f %12.1f", sizes[s], djb, sw);
+#ifdef HAVE_CRC32C_SSE42
+        if (hw) {
+            double hw_ns = time_hash(hash_crc32c_hw, msgs, rounds);
+            best = hw_ns < best ? hw_ns : best;
+            printf(" %12.1f", hw_ns);
+        } else {
+            printf(" %12s", "-");
+        }
+#else
+        printf(" %12s", "-");
+#endif
+        printf(" %9.1fx\n", djb / best);
+    }
+    
+    rng generator;
+    rng_seed(&generator, 1);
+    bool avx2 = fill_avx2_available();
+    printf("\nPayload fill, AVX2: %s\n", avx2 ? "yes" : "no");
+    printf("%8s %12s %12s %12s %10s\n", "payload", "rand() ns", "xoshiro ns", "x4 avx2 ns", "best gain");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t len = (size_t)sizes[s];
+        double slow = time_fill_rand(msgs[0].data, len, rounds / 10);
+        double sw = time_fill(fill_printable_sw, &generator, msgs[0].data, len, rounds);
+        double best = sw;
+        
+        printf("%8zu %12.1f %12.1f", len, slow, sw);
+#ifdef HAVE_FILL_AVX2
+        if (avx2) {
+            double simd = time_fill(fill_printable_avx2, &generator, msgs[0].data, len, rounds);
+            best = simd < best ? simd : best;
+            printf(" %12.1f", simd);
+        } else {
+            printf(" %12s", "-");
+        }
+#else
+        printf(" %12s", "-");
+#endif
+        printf(" %9.1fx\n", slow / best);
+    }
+    
+    return EXIT_SUCCESS;
+}
@@ -8,76 +8,1664 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <semaphore.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+
+#include "checksum.h"
+#include "telemetry.h"
+#include "event.h"
 
 #define SIZE 256
 #define DATA (((SIZE + 3) / 4) * 4)
 #define MAX_AMOUNT 111
 #define BUFFER_SIZE 8
+#define MAX_CAPACITY (1u << 20)
+#define CACHE_LINE 64
+#define SPIN_TRIES 64
+#define MAX_BATCH 64
+#define FUTEX_TIMEOUT_NS 100000000L
+#define BYTE_RING_SIZE 4096
+#define MAX_BYTE_RING_SIZE (1u << 30)
+#define QUEUE_SHM_NAME "message_queue"
+#define QUEUE_FILE_ENV "LAB04_QUEUE_FILE"
+#define QUEUE_SHM_ENV "LAB04_QUEUE_SHM"
+#define QUEUE_MAGIC 0x4C344251u
+#define QUEUE_VERSION 12
+#define MAX_SHARDS 64
+#define MAX_SUBSCRIBERS 32
+#define QUEUE_FEATURE_BYTE_RING (1u << 0)
+#define QUEUE_FEATURE_BROADCAST (1u << 1)
+#define QUEUE_FEATURE_DURABLE (1u << 2)
+#define QUEUE_FEATURE_EVENTFD (1u << 3)
+#define QUEUE_FEATURE_SYNC_COMMIT (1u << 4)
+#define QUEUE_KNOWN_FEATURES (QUEUE_FEATURE_BYTE_RING | QUEUE_FEATURE_BROADCAST | \
+                              QUEUE_FEATURE_DURABLE | QUEUE_FEATURE_EVENTFD | \
+                              QUEUE_FEATURE_SYNC_COMMIT)
+#define RECORD_HEADER 16
+#define RECORD_BUSY (1u << 31)
+#define RECORD_PAD (1u << 30)
+#define RECORD_CONSUMED (1u << 29)
+#define RECORD_LENGTH_MASK (RECORD_CONSUMED - 1)
+#define RECORD_SIZE(len) (((size_t)(len) + RECORD_HEADER + 15) & ~(size_t)15)
+#define CLAIM_CONSUMER (1u << 22)
+#define CLAIM_SHIFT 23
+#define MESSAGE_HOLE 0xFF
+#define REPAIR_WAIT_NS 10000000ull
+#define INTENT_COUNT_SHIFT 6
+#define LOCK_CHECK_SPINS (1u << 16)
+#define STALL_POSITION_BITS 24
+
+/* Checksum in message.hash; the producer records which one in message.algo. */
+enum hash_algo {
+    HASH_DJB,
+    HASH_CRC32C,
+    HASH_ALGO_COUNT
+};
 
 typedef struct {
     uint8_t type;
+    uint8_t algo;
     uint16_t hash;
     uint8_t size;
     uint8_t data[DATA];
 } message;
 
+#define MESSAGE_HEADER offsetof(message, data)
+
+/*
+ * A slot is free for position p when sequence == p and full when sequence
+ * == p + 1. The message follows the sequence word and is cut to the
+ * queue's max_payload, so only message_length() bytes are ever copied.
+ *
+ * claim names the worker holding the slot: the position above
+ * CLAIM_SHIFT, the thread id (at most 22 bits) below it, with
+ * CLAIM_CONSUMER set once a consumer took it. Workers win a slot with
+ * the CAS on tail or head and stamp it right after, before they touch the
+ * message, so a worker killed past that point leaves slots that a
+ * survivor can trace to a dead thread and write off (see queue_repair()).
+ * The stamp is repair metadata only: no worker ever waits on it.
+ */
+typedef struct {
+    atomic_size_t sequence;
+    _Atomic uint64_t claim;
+} slot;
+
+/*
+ * Durable mode: head and tail positions as of the last group commit. Two
+ * of them are written alternately, each with its own checksum, so a torn
+ * write leaves the previous one intact.
+ */
+typedef struct {
+    uint64_t generation;
+    uint64_t head;
+    uint64_t tail;
+    uint32_t crc;
+} commit_record;
+
+/*
+ * Record header in the byte ring: payload length plus BUSY (reserved, not
+ * committed yet), PAD (filler up to the end of the ring) and CONSUMED
+ * (released by the reader, space may be reused) flags. claim works as a
+ * slot's does, with the record's ring position; PAD records carry one too.
+ */
+typedef struct {
+    atomic_uint state;
+    uint32_t reserved;
+    _Atomic uint64_t claim;
+} record_header;
+
+/*
+ * Byte ring of 16-byte aligned, length-prefixed records. Positions only
+ * grow: reclaim <= head <= tail. Producers take the reserve lock just to
+ * carve out [tail, tail + size) and write a BUSY header; the payload is
+ * filled in place afterwards. Consumers claim the record at head, move
+ * head and read it in place; reclaim follows behind over records that were
+ * released. The lock word holds its owner's thread id, so that a lock left
+ * by a killed producer can be taken over.
+ */
+typedef struct {
+    alignas(CACHE_LINE) atomic_int reserve_owner;
+    size_t size;
+    atomic_size_t tail;
+    alignas(CACHE_LINE) atomic_size_t head;
+    alignas(CACHE_LINE) atomic_size_t reclaim;
+    alignas(CACHE_LINE) atomic_uint items_seq;
+    atomic_uint empty_waiters;
+    alignas(CACHE_LINE) atomic_uint space_seq;
+    atomic_uint full_waiters;
+    alignas(CACHE_LINE) uint8_t data[];
+} byte_ring;
+
+/*
+ * Broadcast mode: every subscriber owns a cursor instead of sharing head,
+ * reads each message in place in its slot and then moves the cursor on. A
+ * slot is reused only once the slowest active cursor has passed it. gate
+ * caches that minimum; it only grows and never runs ahead of an active
+ * cursor, so producers rescan the table only when the ring looks full.
+ */
 typedef struct {
-    int added_count; 
-    int extracted_count; 
-    int head; 
-    int tail;  
-    message buffer[BUFFER_SIZE];  
+    alignas(CACHE_LINE) atomic_size_t position;
+    atomic_int owner;
+} cursor;
+
+typedef struct {
+    alignas(CACHE_LINE) atomic_size_t gate;
+    cursor cursors[MAX_SUBSCRIBERS];
+} cursor_table;
+
+/*
+ * Bounded MPMC ring (per-slot sequence numbers). Producers and consumers
+ * only contend on their own cache line; the futex words are touched only
+ * when a side has to sleep on a full or empty ring.
+ *
+ * The struct is also the self-describing header of the shm segment: the
+ * geometry fields are written once by queue_init() (magic last), and
+ * readers map total_size bytes after checking them. The slot array lives
+ * at slots_offset, the byte ring at bytes_offset; only the one the
+ * features select is allocated. Broadcast rings add the cursor table at
+ * cursors_offset.
+ *
+ * The segment holds `shards` such rings back to back, shard_size bytes
+ * apart, each a complete queue with its own copy of the geometry; offsets
+ * are relative to the shard, so every queue_* function works on a shard
+ * as is. Producers route on message.type. Shard 0 also carries the
+ * doorbell that consumers reading several shards sleep on, and
+ * event_armed for consumers waiting on the eventfd instead. The telemetry
+ * block follows the last shard, at telemetry_offset from the segment.
+ */
+typedef struct {
+    atomic_uint magic;
+    uint32_t version;
+    uint32_t features;
+    uint32_t max_payload;
+    uint32_t hash_algo;
+    size_t capacity;
+    size_t slot_size;
+    size_t byte_ring_size;
+    size_t slots_offset;
+    size_t bytes_offset;
+    size_t cursors_offset;
+    size_t total_size;
+    uint32_t shards;
+    uint32_t shard_index;
+    size_t shard_size;
+    size_t telemetry_offset;
+    alignas(CACHE_LINE) commit_record commits[2];
+    atomic_uint commit_seq;
+    atomic_uint commit_waiters;
+    alignas(CACHE_LINE) atomic_uint doorbell_seq;
+    atomic_uint doorbell_waiters;
+    atomic_uint event_armed;
+    alignas(CACHE_LINE) atomic_size_t tail;
+    alignas(CACHE_LINE) atomic_size_t head;
+    alignas(CACHE_LINE) atomic_uint items_seq;
+    atomic_uint empty_waiters;
+    alignas(CACHE_LINE) atomic_uint space_seq;
+    atomic_uint full_waiters;
+    alignas(CACHE_LINE) atomic_int added_count;
+    atomic_int extracted_count;
+    atomic_int repaired_count;
+    alignas(CACHE_LINE) _Atomic uint64_t stall_watch[2];
 } queue;
 
 extern queue *q;
-extern sem_t *mutex;
-extern sem_t *free_space;
-extern sem_t *items;
-extern volatile sig_atomic_t terminate;
+/*
+ * Per thread, so that worker_host can stop one worker thread with a
+ * directed signal; a worker process has just the one.
+ */
+extern _Thread_local volatile sig_atomic_t terminate;
 
-uint16_t calculate_hash(const message *msg) {
+/* The eventfd received from main when the queue has QUEUE_FEATURE_EVENTFD, else -1. */
+static int queue_event_fd = -1;
+
+/* Header plus the payload bytes actually in use; all a record needs to hold. */
+size_t message_length(const message *msg) {
+    return MESSAGE_HEADER + (msg->size == 0 ? 256 : msg->size);
+}
+
+const char *hash_algo_name(int algo) {
+    switch (algo) {
+        case HASH_DJB: return "djb";
+        case HASH_CRC32C: return "crc32c";
+        default: return "unknown";
+    }
+}
+
+int parse_hash_algo(const char *name) {
+    for (int algo = 0; algo < HASH_ALGO_COUNT; algo++) {
+        if (strcmp(name, hash_algo_name(algo)) == 0) {
+            return algo;
+        }
+    }
+    return -1;
+}
+
+/*
+ * The original byte-at-a-time hash, kept for comparison (-a djb). Like
+ * hash_crc32c() it skips the hash field, so a stored message can be
+ * checked without clearing it first.
+ */
+uint16_t hash_djb(const message *msg) {
     uint16_t hash = 0;
     const uint8_t *bytes = (const uint8_t*)msg;
-    size_t size = sizeof(message);
+    size_t size = message_length(msg);
+    
+    size_t hash_start = offsetof(message, hash);
+    size_t hash_end = hash_start + sizeof(msg->hash);
     
     for (size_t i = 0; i < size; i++) {
-        if (i == 1 || i == 2) continue;
+        if (i >= hash_start && i < hash_end) continue;
         hash = (hash << 5) + hash + bytes[i];
     }
     return hash;
 }
 
-// Function to verify hash of message
-void verify_hash(message *msg) {
-    uint16_t stored_hash = msg->hash;
-    msg->hash = 0;
+/*
+ * CRC32C over type, algo, size and the used payload, skipping the hash
+ * field itself, folded to the 16 bits the message has room for.
+ */
+uint16_t hash_crc32c(const message *msg) {
+    const uint8_t *bytes = (const uint8_t*)msg;
+    size_t after_hash = offsetof(message, hash) + sizeof(msg->hash);
+    
+    uint32_t crc = crc32c(0, bytes, offsetof(message, hash));
+    crc = crc32c(crc, bytes + after_hash, message_length(msg) - after_hash);
+    return (uint16_t)(crc ^ (crc >> 16));
+}
+
+uint16_t calculate_hash(const message *msg) {
+    return msg->algo == HASH_CRC32C ? hash_crc32c(msg) : hash_djb(msg);
+}
+
+// Function to verify hash of message; read-only, broadcast subscribers share the slot
+void verify_hash(const message *msg) {
+    if (msg->algo >= HASH_ALGO_COUNT) {
+        fprintf(stderr, "HASH VERIFICATION FAILED: UNKNOWN ALGORITHM %d\n", msg->algo);
+        if (self_stats) {
+            stat_add(&self_stats->checksum_failures, 1);
+        }
+        return;
+    }
+    
     uint16_t calculated_hash = calculate_hash(msg);
     
-    if (calculated_hash != stored_hash) {
+    if (calculated_hash != msg->hash) {
+        if (self_stats) {
+            stat_add(&self_stats->checksum_failures, 1);
+        }
         fprintf(stderr, "HASH VERIFICATION FAILED: CALCULATED %04X != STORED %04X\n", 
-                calculated_hash, stored_hash);
+                calculated_hash, msg->hash);
+    }
+}
+
+/*
+ * Bounded sleep, so a termination signal that races with the wait is still
+ * seen. Every blocking path ends up here, so this is where blocked time is
+ * counted; spinning before it is not.
+ */
+void futex_wait(atomic_uint *word, unsigned int expected) {
+    struct timespec timeout = {0, FUTEX_TIMEOUT_NS};
+    uint64_t start = self_stats ? monotonic_ns() : 0;
+
+    syscall(SYS_futex, (unsigned int *)word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+    if (self_stats) {
+        stat_add(&self_stats->waits, 1);
+        stat_add(&self_stats->blocked_ns, monotonic_ns() - start);
+    }
+}
+
+void futex_wake(atomic_uint *word, int count) {
+    syscall(SYS_futex, (unsigned int *)word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+ * Computes the segment geometry into *layout. Capacities are rounded up to
+ * powers of two; the byte ring is grown so that a record of half the ring
+ * (the largest message) always fits once the ring drains. capacity and
+ * byte_ring_size are per shard.
+ */
+void queue_layout(queue *layout, size_t capacity, size_t max_payload,
+                  size_t byte_ring_size, uint32_t features, size_t shards) {
+    memset(layout, 0, sizeof(queue));
+    layout->version = QUEUE_VERSION;
+    layout->features = features;
+    layout->max_payload = (uint32_t)max_payload;
+    layout->hash_algo = HASH_CRC32C;
+    layout->slot_size = align_up(sizeof(slot) + MESSAGE_HEADER + max_payload, sizeof(size_t));
+    layout->slots_offset = align_up(sizeof(queue), CACHE_LINE);
+
+    if (features & QUEUE_FEATURE_BYTE_RING) {
+        size_t min_ring = 2 * RECORD_SIZE(MESSAGE_HEADER + max_payload);
+        layout->byte_ring_size = round_up_pow2(byte_ring_size < min_ring ? min_ring : byte_ring_size);
+        layout->bytes_offset = layout->slots_offset;
+        layout->total_size = layout->bytes_offset + sizeof(byte_ring) + layout->byte_ring_size;
+    } else {
+        layout->capacity = round_up_pow2(capacity < 2 ? 2 : capacity);
+        layout->bytes_offset = 0;
+        layout->total_size = layout->slots_offset + layout->capacity * layout->slot_size;
+        if (features & QUEUE_FEATURE_BROADCAST) {
+            layout->cursors_offset = align_up(layout->total_size, CACHE_LINE);
+            layout->total_size = layout->cursors_offset + sizeof(cursor_table);
+        }
+    }
+
+    layout->shards = (uint32_t)shards;
+    layout->shard_size = align_up(layout->total_size, CACHE_LINE);
+    layout->telemetry_offset = layout->shard_size * shards;
+    layout->total_size = layout->telemetry_offset + sizeof(telemetry);
+}
+
+queue *queue_shard(queue *segment, size_t index) {
+    return (queue *)((char *)segment + index * segment->shard_size);
+}
+
+/* Shard for a message type; all messages of one type share a FIFO. */
+queue *queue_route(queue *segment, uint8_t type) {
+    return queue_shard(segment, type % segment->shards);
+}
+
+slot *queue_slot(queue *ring, size_t pos) {
+    return (slot *)((char *)ring + ring->slots_offset + (pos & (ring->capacity - 1)) * ring->slot_size);
+}
+
+message *slot_message(slot *cell) {
+    return (message *)(cell + 1);
+}
+
+uint64_t claim_word(size_t pos, unsigned int owner) {
+    return ((uint64_t)pos << CLAIM_SHIFT) | owner;
+}
+
+/* Whether claim was stamped for pos; the position is kept modulo 2^(64 - CLAIM_SHIFT). */
+bool claim_at(uint64_t claim, size_t pos) {
+    return (claim >> CLAIM_SHIFT) == (claim_word(pos, 0) >> CLAIM_SHIFT);
+}
+
+unsigned int claim_owner(uint64_t claim) {
+    return (unsigned int)(claim & (CLAIM_CONSUMER - 1));
+}
+
+/*
+ * Sets the slot for pos to sequence, with the claim a consumer expects if
+ * that means published, else the one a producer expects.
+ */
+void slot_reset(queue *ring, size_t pos, size_t sequence) {
+    slot *cell = queue_slot(ring, pos);
+    atomic_store(&cell->sequence, sequence);
+    atomic_store(&cell->claim, sequence == pos + 1 ? claim_word(pos, 0)
+                                                   : claim_word(pos - ring->capacity, CLAIM_CONSUMER));
+}
+
+/*
+ * Whether claim is still the one that the stamp for pos replaces: the
+ * previous lap's for a producer, the producer's for pos for a consumer.
+ */
+bool claim_unstamped(const queue *ring, uint64_t claim, size_t pos, bool consumer) {
+    return consumer ? claim_at(claim, pos) && !(claim & CLAIM_CONSUMER) : claim_at(claim, pos - ring->capacity);
+}
+
+/*
+ * Announces, in this worker's telemetry entry, the count positions from
+ * pos that it is about to take with the CAS on tail or head, so that the
+ * ones it wins can be traced to it before they are stamped (see
+ * slot_abandoned()). Only this worker writes the line. The CAS that
+ * follows is a release, and repair loads tail and head before it looks.
+ */
+void claim_intent(const queue *ring, size_t pos, size_t count, bool consumer) {
+    if (self_stats) {
+        unsigned int what = (consumer ? CLAIM_CONSUMER : 0) | (unsigned int)(count << INTENT_COUNT_SHIFT) |
+                            ring->shard_index;
+        atomic_store_explicit(&self_stats->intent, claim_word(pos, what), memory_order_relaxed);
+    }
+}
+
+/*
+ * Stamps this worker on the slot for pos, which it has just won with the
+ * CAS on tail or head: owner is its thread id, with CLAIM_CONSUMER on the
+ * consumer side. The worker announced the slot beforehand, so nobody
+ * writes it off while the worker lives and a plain store does.
+ */
+void slot_claim(slot *cell, size_t pos, unsigned int owner) {
+    atomic_store_explicit(&cell->claim, claim_word(pos, owner), memory_order_relaxed);
+}
+
+/*
+ * Stamps the rest of a run of count slots whose first one the caller has
+ * just stamped. Repair goes through a ring in order, and nothing after the
+ * first slot is in its reach before that one is published or released, so
+ * plain stores do.
+ */
+void slot_stamp_run(queue *ring, size_t pos, size_t count, unsigned int owner) {
+    for (size_t i = 1; i < count; i++) {
+        atomic_store_explicit(&queue_slot(ring, pos + i)->claim, claim_word(pos + i, owner), memory_order_relaxed);
+    }
+}
+
+telemetry *queue_telemetry(queue *segment) {
+    return (telemetry *)((char *)segment + segment->telemetry_offset);
+}
+
+byte_ring *queue_bytes(queue *ring) {
+    return (byte_ring *)((char *)ring + ring->bytes_offset);
+}
+
+cursor_table *queue_cursors(queue *ring) {
+    return (cursor_table *)((char *)ring + ring->cursors_offset);
+}
+
+bool queue_broadcast_mode(const queue *ring) {
+    return (ring->features & QUEUE_FEATURE_BROADCAST) != 0;
+}
+
+/* Initializes a freshly mapped segment of layout->total_size bytes. */
+void queue_init(queue *segment, const queue *layout) {
+    memset(segment, 0, layout->total_size);
+
+    for (size_t index = layout->shards; index-- > 0; ) {
+        queue *ring = (queue *)((char *)segment + index * layout->shard_size);
+        memcpy(ring, layout, sizeof(queue));
+        ring->shard_index = (uint32_t)index;
+
+        if (ring->features & QUEUE_FEATURE_BYTE_RING) {
+            queue_bytes(ring)->size = ring->byte_ring_size;
+        } else if (ring->features & QUEUE_FEATURE_BROADCAST) {
+            /* As if the lap before position 0 had been published. */
+            for (size_t i = 0; i < ring->capacity; i++) {
+                slot_reset(ring, i, i + 1 - ring->capacity);
+            }
+        } else {
+            for (size_t i = 0; i < ring->capacity; i++) {
+                slot_reset(ring, i, i);
+            }
+        }
+        atomic_store_explicit(&ring->magic, QUEUE_MAGIC, memory_order_release);
+    }
+}
+
+/* Checks a header found in shm; returns false with a message when it can't be used. */
+bool queue_check(const queue *header, size_t file_size) {
+    if (atomic_load_explicit(&((queue *)header)->magic, memory_order_acquire) != QUEUE_MAGIC) {
+        fprintf(stderr, "shm: not a message queue (bad magic)\n");
+        return false;
+    }
+    if (header->version != QUEUE_VERSION) {
+        fprintf(stderr, "shm: queue version %u, expected %u\n", header->version, QUEUE_VERSION);
+        return false;
+    }
+    if (header->features & ~QUEUE_KNOWN_FEATURES) {
+        fprintf(stderr, "shm: unknown queue features %#x\n", header->features & ~QUEUE_KNOWN_FEATURES);
+        return false;
+    }
+    if (header->total_size > file_size || header->max_payload == 0 || header->max_payload > SIZE ||
+        header->hash_algo >= HASH_ALGO_COUNT || header->shards == 0 || header->shards > MAX_SHARDS ||
+        header->telemetry_offset != header->shards * header->shard_size ||
+        header->total_size != header->telemetry_offset + sizeof(telemetry) ||
+        ((header->features & QUEUE_FEATURE_BYTE_RING) && (header->features & QUEUE_FEATURE_BROADCAST)) ||
+        ((header->features & QUEUE_FEATURE_DURABLE) &&
+         (header->features & (QUEUE_FEATURE_BYTE_RING | QUEUE_FEATURE_BROADCAST)))) {
+        fprintf(stderr, "shm: inconsistent queue header\n");
+        return false;
+    }
+    return true;
+}
+
+/* Bumps the event word and wakes up to count sleepers, if anyone registered as waiting. */
+void queue_notify_many(atomic_uint *seq, atomic_uint *waiters, size_t count) {
+    atomic_fetch_add(seq, 1);
+    if (atomic_load(waiters) > 0) {
+        futex_wake(seq, (int)count);
+    }
+}
+
+void queue_notify(atomic_uint *seq, atomic_uint *waiters) {
+    queue_notify_many(seq, waiters, 1);
+}
+
+/*
+ * Repair. A worker killed while it holds slots leaves them half-owned:
+ *  - tail moved, never published: stops every consumer at head;
+ *  - head moved, never released: stops the producers one lap later.
+ * Nobody else is held up before that, as the CAS on tail or head is all a
+ * worker needs to move on. Workers that wait without progress look at
+ * those two places (queue_repair()) once they have been stuck for
+ * REPAIR_WAIT_NS. A slot whose stamp names a dead worker is written off
+ * with a CAS on its claim, which also keeps two repairing workers apart.
+ * A slot without a stamp is between the CAS and the stamp; the worker
+ * announced it in its telemetry entry before the CAS (claim_intent()), and
+ * that names it. Every worker has an entry (telemetry_join() refuses to
+ * start one otherwise), so a slot is never written off while its holder
+ * lives. Written-off messages are lost and counted in repaired_count.
+ */
+enum stall_side {
+    STALL_HEAD,
+    STALL_TAIL
+};
+
+/*
+ * How long the shard has been seen stuck at pos on one side; 0 on the
+ * first look. The watch lives in the shard, not in the worker, so it
+ * survives the workers that look at it being killed in turn. One word,
+ * milliseconds since boot above the low STALL_POSITION_BITS of pos, so
+ * that no half-written pair can be seen.
+ */
+uint64_t stalled_for(queue *shard, enum stall_side side, size_t pos) {
+    _Atomic uint64_t *watch = &shard->stall_watch[side];
+    uint64_t mask = (1ull << STALL_POSITION_BITS) - 1;
+    uint64_t now_ms = monotonic_ns() / 1000000;
+    uint64_t seen = atomic_load(watch);
+
+    if ((seen >> STALL_POSITION_BITS) != 0 && (seen & mask) == (pos & mask)) {
+        uint64_t since_ms = seen >> STALL_POSITION_BITS;
+        return now_ms > since_ms ? (now_ms - since_ms) * 1000000 : 0;
+    }
+    atomic_compare_exchange_strong(watch, &seen, (now_ms << STALL_POSITION_BITS) | (pos & mask));
+    return 0;
+}
+
+/*
+ * Whether claim is pos's on the given side and its holder is gone. A
+ * producer claim without an owner was written off at tail already.
+ */
+bool claim_abandoned(uint64_t claim, size_t pos, bool consumer) {
+    if (!claim_at(claim, pos) || ((claim & CLAIM_CONSUMER) != 0) != consumer) {
+        return false;
+    }
+    unsigned int owner = claim_owner(claim);
+    return owner == 0 ? !consumer : !worker_alive(queue_telemetry(q), (int)owner);
+}
+
+/* Whether intent, as claim_intent() stores it, covers pos on the given side of ring. */
+bool intent_covers(uint64_t intent, const queue *ring, size_t pos, bool consumer) {
+    unsigned int what = claim_owner(intent);
+    uint64_t offset = (claim_word(pos, 0) - (intent & (~(uint64_t)0 << CLAIM_SHIFT))) >> CLAIM_SHIFT;
+    return ((intent & CLAIM_CONSUMER) != 0) == consumer &&
+           (what & ((1u << INTENT_COUNT_SHIFT) - 1)) == ring->shard_index && offset < (what >> INTENT_COUNT_SHIFT);
+}
+
+/*
+ * Whether the worker that won pos on the given side of ring and has not
+ * stamped it yet is gone: the one that announced it (a live one wins over
+ * dead ones with a stale announcement, and reaped workers are found among
+ * the orphan intents). Nobody found means nothing is written off.
+ */
+bool unstamped_abandoned(const queue *ring, size_t pos, bool consumer) {
+    telemetry *stats = queue_telemetry(q);
+    bool named = false;
+
+    for (size_t i = 0; i < 2 * TELEMETRY_WORKERS; i++) {
+        worker_stats *entry = i < TELEMETRY_WORKERS ? &stats->producers[i] : &stats->consumers[i - TELEMETRY_WORKERS];
+        int pid = atomic_load(&entry->pid);
+        if (pid <= 0 || !intent_covers(atomic_load(&entry->intent), ring, pos, consumer)) {
+            continue;
+        }
+        if (worker_alive(stats, pid)) {
+            return false;
+        }
+        named = true;
+    }
+    for (size_t i = 0; i < TELEMETRY_ORPHANS && !named; i++) {
+        named = intent_covers(atomic_load(&stats->orphan_intents[i]), ring, pos, consumer);
+    }
+    return named;
+}
+
+/*
+ * Whether the slot for pos, which tail or head has passed, was left by a
+ * worker that is gone: stamped by a dead one, or won by a dead one that
+ * had not stamped it yet.
+ */
+bool slot_abandoned(const queue *ring, uint64_t claim, size_t pos, bool consumer) {
+    if (claim_unstamped(ring, claim, pos, consumer)) {
+        return unstamped_abandoned(ring, pos, consumer);
+    }
+    return claim_abandoned(claim, pos, consumer);
+}
+
+/*
+ * Slots from head on that a dead producer took and never published: head
+ * moves past them. Consumers never move head over an unpublished slot, so
+ * nobody else can have.
+ */
+void slot_repair_unpublished(queue *ring, size_t pos) {
+    for (;;) {
+        slot *cell = queue_slot(ring, pos);
+        uint64_t claim = atomic_load(&cell->claim);
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos ||
+            atomic_load(&ring->tail) <= pos || atomic_load(&ring->head) != pos ||
+            !slot_abandoned(ring, claim, pos, false) ||
+            !atomic_compare_exchange_strong(&cell->claim, &claim, claim_word(pos, CLAIM_CONSUMER))) {
+            return;
+        }
+        size_t expected = pos;
+        atomic_compare_exchange_strong(&ring->head, &expected, pos + 1);
+        atomic_store_explicit(&cell->sequence, pos + ring->capacity, memory_order_release);
+        atomic_fetch_add(&ring->repaired_count, 1);
+        queue_notify(&ring->space_seq, &ring->full_waiters);
+        pos++;
+    }
+}
+
+/*
+ * Slots from pos on, behind head, that a dead consumer took and never
+ * released: freed, messages dropped.
+ */
+void slot_repair_unreleased(queue *ring, size_t pos) {
+    for (;;) {
+        slot *cell = queue_slot(ring, pos);
+        uint64_t claim = atomic_load(&cell->claim);
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1 ||
+            atomic_load(&ring->head) <= pos || !slot_abandoned(ring, claim, pos, true) ||
+            !atomic_compare_exchange_strong(&cell->claim, &claim, claim_word(pos, CLAIM_CONSUMER))) {
+            return;
+        }
+        atomic_store_explicit(&cell->sequence, pos + ring->capacity, memory_order_release);
+        atomic_fetch_add(&ring->repaired_count, 1);
+        atomic_fetch_add(&ring->extracted_count, 1);
+        queue_notify(&ring->space_seq, &ring->full_waiters);
+        pos++;
+    }
+}
+
+/*
+ * Broadcast: a position taken by a producer that never published it,
+ * which every subscriber would wait on forever. It is published as a hole,
+ * a message with algo MESSAGE_HOLE that subscribers skip.
+ */
+bool broadcast_fill_hole(queue *ring, size_t pos) {
+    slot *cell = queue_slot(ring, pos);
+    uint64_t claim = atomic_load(&cell->claim);
+    if (pos >= atomic_load(&ring->tail) ||
+        atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1 - ring->capacity ||
+        !slot_abandoned(ring, claim, pos, false) ||
+        !atomic_compare_exchange_strong(&cell->claim, &claim, claim_word(pos, CLAIM_CONSUMER))) {
+        return false;
+    }
+
+    message *hole = slot_message(cell);
+    memset(hole, 0, MESSAGE_HEADER + 1);
+    hole->algo = MESSAGE_HOLE;
+    hole->size = 1;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    atomic_fetch_add(&ring->repaired_count, 1);
+    queue_notify_many(&ring->items_seq, &ring->empty_waiters, INT_MAX);
+    return true;
+}
+
+/* Broadcast: frees the cursors of subscribers that died, which would hold the producers back for good. */
+void broadcast_reap_cursors(queue *ring) {
+    cursor_table *table = queue_cursors(ring);
+
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        cursor *reader = &table->cursors[i];
+        int owner = atomic_load(&reader->owner);
+        if (owner != 0 && !worker_alive(queue_telemetry(q), owner) && atomic_compare_exchange_strong(&reader->owner, &owner, 0)) {
+            atomic_fetch_add(&ring->repaired_count, 1);
+            queue_notify_many(&ring->space_seq, &ring->full_waiters, INT_MAX);
+        }
+    }
+}
+
+/*
+ * Slot and broadcast rings: what a worker that waited without progress
+ * checks. For a broadcast subscriber, reader is its cursor.
+ */
+void slot_repair(queue *ring, cursor *reader) {
+    size_t tail = atomic_load(&ring->tail);
+
+    if (reader) {
+        size_t pos = atomic_load(&reader->position);
+        if (stalled_for(ring, STALL_HEAD, pos) >= REPAIR_WAIT_NS) {
+            broadcast_fill_hole(ring, pos);
+        }
+    } else if (queue_broadcast_mode(ring)) {
+        if (stalled_for(ring, STALL_TAIL, tail) >= REPAIR_WAIT_NS) {
+            broadcast_reap_cursors(ring);
+        }
+    } else {
+        size_t head = atomic_load(&ring->head);
+        if (tail > head && stalled_for(ring, STALL_HEAD, head) >= REPAIR_WAIT_NS) {
+            slot_repair_unpublished(ring, head);
+        }
+        if (tail >= ring->capacity && stalled_for(ring, STALL_TAIL, tail - ring->capacity) >= REPAIR_WAIT_NS) {
+            slot_repair_unreleased(ring, tail - ring->capacity);
+        }
+    }
+}
+
+/* Lowest position an active subscriber has yet to read; tail when nobody is subscribed. */
+size_t broadcast_min(queue *ring) {
+    cursor_table *table = queue_cursors(ring);
+    size_t min = atomic_load(&ring->tail);
+
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        cursor *reader = &table->cursors[i];
+        if (atomic_load(&reader->owner) != 0) {
+            size_t pos = atomic_load(&reader->position);
+            if (pos < min) {
+                min = pos;
+            }
+        }
+    }
+    return min;
+}
+
+/* Raises the cached gate to value unless another producer already moved it further. */
+size_t broadcast_raise_gate(cursor_table *table, size_t value) {
+    size_t gate = atomic_load(&table->gate);
+    while (gate < value && !atomic_compare_exchange_weak(&table->gate, &gate, value)) {
+    }
+    return gate < value ? value : gate;
+}
+
+/*
+ * Claims up to count positions, as far as the gate allows, with one CAS
+ * on tail, and publishes a message in each. A slot is written only after
+ * the previous lap's writer published it, which matters when nobody is
+ * subscribed and the ring runs free; if that writer is gone, the wait
+ * turns its position into a hole. Returns how many were stored.
+ */
+size_t broadcast_try_put_batch(queue *ring, const message *msgs, size_t count) {
+    cursor_table *table = queue_cursors(ring);
+    unsigned int self = (unsigned int)worker_id();
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t room;
+
+    for (;;) {
+        size_t gate = atomic_load_explicit(&table->gate, memory_order_acquire);
+        room = gate + ring->capacity - pos;
+        if (room == 0) {
+            gate = broadcast_raise_gate(table, broadcast_min(ring));
+            room = gate + ring->capacity - pos;
+            if (room == 0) {
+                return 0;
+            }
+        }
+        if (room > count) {
+            room = count;
+        }
+        claim_intent(ring, pos, room, false);
+        if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + room,
+                                                  memory_order_release, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < room; i++) {
+        slot *cell = queue_slot(ring, pos + i);
+        for (unsigned int spin = 1;
+             atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + i + 1 - ring->capacity; spin++) {
+            if (spin % LOCK_CHECK_SPINS == 0) {
+                broadcast_fill_hole(ring, pos + i - ring->capacity);
+            }
+        }
+        slot_claim(cell, pos + i, self);
+        memcpy(slot_message(cell), &msgs[i], message_length(&msgs[i]));
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+    }
+    return room;
+}
+
+/* The CAS on tail wins the slot; the stamp that follows is for repair only. */
+bool queue_try_put(queue *ring, const message *msg) {
+    if (queue_broadcast_mode(ring)) {
+        return broadcast_try_put_batch(ring, msg, 1) == 1;
+    }
+
+    unsigned int self = (unsigned int)worker_id();
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    slot *cell;
+
+    for (;;) {
+        cell = queue_slot(ring, pos);
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            claim_intent(ring, pos, 1, false);
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_release, memory_order_relaxed)) {
+                slot_claim(cell, pos, self);
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot_message(cell), msg, message_length(msg));
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+/* The mirror of queue_try_put(). */
+bool queue_try_get(queue *ring, message *msg) {
+    unsigned int self = CLAIM_CONSUMER | (unsigned int)worker_id();
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    slot *cell;
+
+    for (;;) {
+        cell = queue_slot(ring, pos);
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            claim_intent(ring, pos, 1, true);
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_release, memory_order_relaxed)) {
+                slot_claim(cell, pos, self);
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    const message *stored = slot_message(cell);
+    memcpy(msg, stored, message_length(stored));
+    atomic_store_explicit(&cell->sequence, pos + ring->capacity, memory_order_release);
+    return true;
+}
+
+/*
+ * Claims up to count consecutive free slots with a single CAS on tail.
+ * Every slot of the run is checked to be free for its position before the
+ * CAS, so once it succeeds the whole run is owned; it is all stamped
+ * before anything is written. Returns how many messages were stored, in
+ * order from msgs[0]; 0 when the ring is full.
+ */
+size_t queue_try_put_batch(queue *ring, const message *msgs, size_t count) {
+    if (queue_broadcast_mode(ring)) {
+        return broadcast_try_put_batch(ring, msgs, count);
+    }
+
+    unsigned int self = (unsigned int)worker_id();
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t ready;
+
+    for (;;) {
+        for (ready = 0; ready < count; ready++) {
+            size_t seq = atomic_load_explicit(&queue_slot(ring, pos + ready)->sequence,
+                                              memory_order_acquire);
+            if (seq != pos + ready) {
+                break;
+            }
+        }
+
+        if (ready > 0) {
+            claim_intent(ring, pos, ready, false);
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + ready,
+                                                      memory_order_release, memory_order_relaxed)) {
+                slot_claim(queue_slot(ring, pos), pos, self);
+                slot_stamp_run(ring, pos, ready, self);
+                break;
+            }
+            continue;
+        }
+
+        size_t seq = atomic_load_explicit(&queue_slot(ring, pos)->sequence, memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)pos < 0) {
+            return 0;
+        }
+        pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < ready; i++) {
+        slot *cell = queue_slot(ring, pos + i);
+        memcpy(slot_message(cell), &msgs[i], message_length(&msgs[i]));
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+    }
+    return ready;
+}
+
+/*
+ * Batch counterpart of queue_try_get(): takes up to count messages with
+ * one CAS on head, and stamps them all before the first is released.
+ */
+size_t queue_try_get_batch(queue *ring, message *msgs, size_t count) {
+    unsigned int self = CLAIM_CONSUMER | (unsigned int)worker_id();
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t ready;
+
+    for (;;) {
+        for (ready = 0; ready < count; ready++) {
+            size_t seq = atomic_load_explicit(&queue_slot(ring, pos + ready)->sequence,
+                                              memory_order_acquire);
+            if (seq != pos + ready + 1) {
+                break;
+            }
+        }
+
+        if (ready > 0) {
+            claim_intent(ring, pos, ready, true);
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + ready,
+                                                      memory_order_release, memory_order_relaxed)) {
+                break;
+            }
+            continue;
+        }
+
+        size_t seq = atomic_load_explicit(&queue_slot(ring, pos)->sequence, memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+            return 0;
+        }
+        pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    }
+
+    slot_claim(queue_slot(ring, pos), pos, self);
+    slot_stamp_run(ring, pos, ready, self);
+    for (size_t i = 0; i < ready; i++) {
+        slot *cell = queue_slot(ring, pos + i);
+        const message *stored = slot_message(cell);
+        memcpy(&msgs[i], stored, message_length(stored));
+        atomic_store_explicit(&cell->sequence, pos + i + ring->capacity, memory_order_release);
+    }
+    return ready;
+}
+
+/* Consumers to wake for put new messages: in broadcast mode every subscriber wants each one. */
+size_t queue_wake_count(const queue *ring, size_t put) {
+    return queue_broadcast_mode(ring) ? INT_MAX : put;
+}
+
+/*
+ * Blocking put: spins briefly, then sleeps on space_seq until a consumer
+ * frees a slot. Returns the new added_count, or -1 once terminate is set.
+ */
+int queue_put(queue *ring, const message *msg) {
+    for (int spin = 0; !queue_try_put(ring, msg); spin++) {
+        if (terminate) {
+            return -1;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&ring->space_seq);
+        atomic_fetch_add(&ring->full_waiters, 1);
+        if (queue_try_put(ring, msg)) {
+            atomic_fetch_sub(&ring->full_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->space_seq, seen);
+        atomic_fetch_sub(&ring->full_waiters, 1);
+        slot_repair(ring, NULL);
+    }
+
+    queue_notify_many(&ring->items_seq, &ring->empty_waiters, queue_wake_count(ring, 1));
+    return atomic_fetch_add(&ring->added_count, 1) + 1;
+}
+
+/* Blocking get, the mirror of queue_put(). Returns the new extracted_count or -1. */
+int queue_get(queue *ring, message *msg) {
+    for (int spin = 0; !queue_try_get(ring, msg); spin++) {
+        if (terminate) {
+            return -1;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&ring->items_seq);
+        atomic_fetch_add(&ring->empty_waiters, 1);
+        if (queue_try_get(ring, msg)) {
+            atomic_fetch_sub(&ring->empty_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->items_seq, seen);
+        atomic_fetch_sub(&ring->empty_waiters, 1);
+        slot_repair(ring, NULL);
+    }
+
+    queue_notify(&ring->space_seq, &ring->full_waiters);
+    return atomic_fetch_add(&ring->extracted_count, 1) + 1;
+}
+
+/*
+ * Blocking batch put: stores all count messages, as many per claim as the
+ * ring has room for. *stored receives the number stored, msgs[0..*stored)
+ * in order; it is short of count only once terminate is set. Returns the
+ * added_count after the last one stored, or -1 when none was.
+ */
+int queue_put_batch(queue *ring, const message *msgs, size_t count, size_t *stored) {
+    size_t done = 0;
+    int added = -1;
+
+    for (int spin = 0; done < count; spin++) {
+        size_t put = queue_try_put_batch(ring, msgs + done, count - done);
+        if (put == 0) {
+            if (terminate) {
+                break;
+            }
+            if (spin < SPIN_TRIES) {
+                continue;
+            }
+
+            unsigned int seen = atomic_load(&ring->space_seq);
+            atomic_fetch_add(&ring->full_waiters, 1);
+            put = queue_try_put_batch(ring, msgs + done, count - done);
+            if (put == 0) {
+                futex_wait(&ring->space_seq, seen);
+            }
+            atomic_fetch_sub(&ring->full_waiters, 1);
+            if (put == 0) {
+                slot_repair(ring, NULL);
+                continue;
+            }
+        }
+
+        done += put;
+        spin = 0;
+        queue_notify_many(&ring->items_seq, &ring->empty_waiters, queue_wake_count(ring, put));
+        added = atomic_fetch_add(&ring->added_count, (int)put) + (int)put;
+    }
+    *stored = done;
+    return added;
+}
+
+/*
+ * Blocking batch get: waits for at least one message and takes up to count
+ * of them. *got receives the number taken. Returns the extracted_count
+ * after the last one, or -1 once terminate is set.
+ */
+int queue_get_batch(queue *ring, message *msgs, size_t count, size_t *got) {
+    size_t taken;
+
+    for (int spin = 0; (taken = queue_try_get_batch(ring, msgs, count)) == 0; spin++) {
+        if (terminate) {
+            return -1;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&ring->items_seq);
+        atomic_fetch_add(&ring->empty_waiters, 1);
+        taken = queue_try_get_batch(ring, msgs, count);
+        if (taken > 0) {
+            atomic_fetch_sub(&ring->empty_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->items_seq, seen);
+        atomic_fetch_sub(&ring->empty_waiters, 1);
+        slot_repair(ring, NULL);
+    }
+
+    *got = taken;
+    queue_notify_many(&ring->space_seq, &ring->full_waiters, taken);
+    return atomic_fetch_add(&ring->extracted_count, (int)taken) + (int)taken;
+}
+
+/*
+ * Wakes a consumer that sleeps on several shards at once, or on the
+ * eventfd. When nobody waits this is a fence and a load or two; the fence
+ * pairs with the waiter's increment of doorbell_waiters (or its store to
+ * event_armed), so either the producer sees the waiter or the waiter's
+ * recheck sees the message.
+ *
+ * A consumer arms event_armed only after finding its shards empty, and
+ * the first producer to publish after that takes the flag back: one
+ * eventfd write per empty to non-empty edge, however many messages follow.
+ */
+void queue_doorbell(queue *segment) {
+    if (segment->shards == 1 && queue_event_fd == -1) {
+        return;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (segment->shards > 1 &&
+        atomic_load_explicit(&segment->doorbell_waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&segment->doorbell_seq, 1);
+        futex_wake(&segment->doorbell_seq, 1);
+    }
+    if (queue_event_fd != -1 && atomic_load_explicit(&segment->event_armed, memory_order_relaxed) &&
+        atomic_exchange(&segment->event_armed, 0)) {
+        uint64_t one = 1;
+        if (write(queue_event_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+            perror("eventfd write");
+        }
+    }
+}
+
+/* Messages waiting; in broadcast mode, the backlog of the slowest subscriber. */
+size_t queue_length(queue *ring) {
+    size_t tail = atomic_load(&ring->tail);
+    size_t head = queue_broadcast_mode(ring) ? broadcast_min(ring) : atomic_load(&ring->head);
+    return tail > head ? tail - head : 0;
+}
+
+/*
+ * Takes a free cursor and starts it at the current tail; NULL when all
+ * MAX_SUBSCRIBERS are taken. tail is read only after the cursor became
+ * visible: a producer that scanned the table before that can still claim
+ * at most that very position, so nothing from there on is reused early.
+ */
+cursor *broadcast_subscribe(queue *ring) {
+    cursor_table *table = queue_cursors(ring);
+
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        cursor *reader = &table->cursors[i];
+        int free_owner = 0;
+        if (atomic_compare_exchange_strong(&reader->owner, &free_owner, worker_id())) {
+            atomic_store(&reader->position, atomic_load(&ring->tail));
+            return reader;
+        }
+    }
+    return NULL;
+}
+
+/* Drops the cursor; producers gated on it are woken to rescan. */
+void broadcast_unsubscribe(queue *ring, cursor *reader) {
+    atomic_store(&reader->owner, 0);
+    queue_notify_many(&ring->space_seq, &ring->full_waiters, INT_MAX);
+}
+
+/* Up to count messages published at the cursor, left in their slots: msgs points into the ring. */
+size_t broadcast_peek(queue *ring, cursor *reader, message **msgs, size_t count) {
+    size_t pos = atomic_load_explicit(&reader->position, memory_order_relaxed);
+    size_t ready = 0;
+
+    while (ready < count) {
+        slot *cell = queue_slot(ring, pos + ready);
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + ready + 1) {
+            break;
+        }
+        msgs[ready++] = slot_message(cell);
+    }
+    return ready;
+}
+
+/* Moves the cursor past count peeked messages; their slots may be reused after that. */
+void broadcast_release(queue *ring, cursor *reader, size_t count) {
+    atomic_fetch_add_explicit(&reader->position, count, memory_order_release);
+    queue_notify(&ring->space_seq, &ring->full_waiters);
+}
+
+/* Blocking broadcast_peek(), same spin-then-futex scheme as queue_get(). 0 once terminate is set. */
+size_t broadcast_peek_wait(queue *ring, cursor *reader, message **msgs, size_t count) {
+    size_t got;
+
+    for (int spin = 0; (got = broadcast_peek(ring, reader, msgs, count)) == 0; spin++) {
+        if (terminate) {
+            return 0;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&ring->items_seq);
+        atomic_fetch_add(&ring->empty_waiters, 1);
+        got = broadcast_peek(ring, reader, msgs, count);
+        if (got > 0) {
+            atomic_fetch_sub(&ring->empty_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->items_seq, seen);
+        atomic_fetch_sub(&ring->empty_waiters, 1);
+        slot_repair(ring, reader);
+    }
+    return got;
+}
+
+record_header *ring_record(byte_ring *ring, size_t pos) {
+    return (record_header *)&ring->data[pos & (ring->size - 1)];
+}
+
+/* Moves reclaim over released records; any process may do it, the CAS picks one. */
+void ring_reclaim(byte_ring *ring) {
+    size_t pos = atomic_load(&ring->reclaim);
+
+    while (pos != atomic_load(&ring->head)) {
+        unsigned int state = atomic_load_explicit(&ring_record(ring, pos)->state,
+                                                  memory_order_acquire);
+        if (!(state & RECORD_CONSUMED)) {
+            break;
+        }
+        size_t next = pos + RECORD_SIZE(state & RECORD_LENGTH_MASK);
+        if (atomic_compare_exchange_strong(&ring->reclaim, &pos, next)) {
+            pos = next;
+        }
+    }
+}
+
+bool queue_byte_mode(const queue *ring) {
+    return (ring->features & QUEUE_FEATURE_BYTE_RING) != 0;
+}
+
+size_t ring_used(byte_ring *ring) {
+    return atomic_load(&ring->tail) - atomic_load(&ring->reclaim);
+}
+
+/*
+ * Spins for the reserve lock. Every LOCK_CHECK_SPINS tries the holder is
+ * looked up, and a holder that died is replaced: the lock only guards a
+ * few stores that end with the one to tail, so whatever it left is either
+ * not visible yet or complete (a BUSY record left behind is ring_repair()'s).
+ */
+void ring_lock(byte_ring *ring) {
+    int self = worker_id();
+    int owner = 0;
+
+    for (unsigned int spin = 1;
+         !atomic_compare_exchange_weak_explicit(&ring->reserve_owner, &owner, self,
+                                                memory_order_acquire, memory_order_relaxed); spin++) {
+        if (spin % LOCK_CHECK_SPINS != 0 || owner == 0 || worker_alive(queue_telemetry(q), owner)) {
+            owner = 0;
+        }
+    }
+}
+
+void ring_unlock(byte_ring *ring) {
+    atomic_store_explicit(&ring->reserve_owner, 0, memory_order_release);
+}
+
+/*
+ * Reserves len contiguous bytes for a record and returns where to write
+ * them, or NULL when the ring has no room. If the record would wrap, the
+ * rest of the ring is filled with a PAD record first.
+ */
+void *ring_reserve(byte_ring *ring, size_t len) {
+    size_t size = RECORD_SIZE(len);
+    void *payload = NULL;
+
+    ring_reclaim(ring);
+    ring_lock(ring);
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t offset = tail & (ring->size - 1);
+    size_t pad = offset + size > ring->size ? ring->size - offset : 0;
+    size_t reclaim = atomic_load_explicit(&ring->reclaim, memory_order_acquire);
+
+    if (tail + pad + size - reclaim <= ring->size) {
+        unsigned int self = (unsigned int)worker_id();
+        if (pad) {
+            record_header *filler = ring_record(ring, tail);
+            atomic_store_explicit(&filler->state, RECORD_PAD | (unsigned int)(pad - RECORD_HEADER),
+                                  memory_order_relaxed);
+            atomic_store_explicit(&filler->claim, claim_word(tail, self), memory_order_relaxed);
+        }
+        record_header *record = ring_record(ring, tail + pad);
+        atomic_store_explicit(&record->state, RECORD_BUSY | (unsigned int)len,
+                              memory_order_relaxed);
+        atomic_store_explicit(&record->claim, claim_word(tail + pad, self), memory_order_relaxed);
+        atomic_store_explicit(&ring->tail, tail + pad + size, memory_order_release);
+        payload = record + 1;
+    }
+
+    ring_unlock(ring);
+    return payload;
+}
+
+/* Publishes a reserved record to consumers. */
+void ring_commit(byte_ring *ring, void *payload) {
+    record_header *record = (record_header *)payload - 1;
+    atomic_fetch_and_explicit(&record->state, ~RECORD_BUSY, memory_order_release);
+    queue_notify(&ring->items_seq, &ring->empty_waiters);
+}
+
+/* Stamps this reader on the record at pos after the CAS on head, as slot_claim() does for a slot. */
+void record_claim(record_header *record, size_t pos) {
+    atomic_store_explicit(&record->claim, claim_word(pos, CLAIM_CONSUMER | (unsigned int)worker_id()),
+                          memory_order_relaxed);
+}
+
+/*
+ * Claims the oldest committed record of a shard's byte ring and returns it
+ * in place, or NULL when the ring is empty or the oldest record is still
+ * being written. Records are won by the CAS on head and stamped, as slots
+ * are. PAD records are released on the spot.
+ */
+void *ring_peek(queue *shard, size_t *len) {
+    byte_ring *ring = queue_bytes(shard);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (head != atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+        record_header *record = ring_record(ring, head);
+        unsigned int state = atomic_load_explicit(&record->state, memory_order_acquire);
+        if (state & RECORD_BUSY) {
+            return NULL;
+        }
+
+        size_t next = head + RECORD_SIZE(state & RECORD_LENGTH_MASK);
+        claim_intent(shard, head, 1, true);
+        if (!atomic_compare_exchange_weak(&ring->head, &head, next)) {
+            continue;
+        }
+        if (state & RECORD_PAD) {
+            atomic_fetch_or_explicit(&record->state, RECORD_CONSUMED, memory_order_release);
+            head = next;
+            continue;
+        }
+        record_claim(record, head);
+
+        *len = state & RECORD_LENGTH_MASK;
+        return record + 1;
+    }
+    return NULL;
+}
+
+/* Gives a peeked record back; its space is reused once everything before it is released too. */
+void ring_release(byte_ring *ring, void *payload) {
+    record_header *record = (record_header *)payload - 1;
+    atomic_fetch_or_explicit(&record->state, RECORD_CONSUMED, memory_order_release);
+    ring_reclaim(ring);
+    queue_notify(&ring->space_seq, &ring->full_waiters);
+}
+
+/*
+ * Byte-ring counterpart of slot_repair(): a BUSY record at head whose
+ * producer died becomes padding, and a record at reclaim that head passed
+ * and whose reader is gone (by the rules of slot_abandoned()) is released
+ * for it.
+ */
+void ring_repair(queue *shard) {
+    byte_ring *ring = queue_bytes(shard);
+    size_t head = atomic_load(&ring->head);
+    size_t reclaim = atomic_load(&ring->reclaim);
+
+    if (head != atomic_load(&ring->tail) && stalled_for(shard, STALL_HEAD, head) >= REPAIR_WAIT_NS) {
+        record_header *record = ring_record(ring, head);
+        unsigned int state = atomic_load_explicit(&record->state, memory_order_acquire);
+        uint64_t claim = atomic_load(&record->claim);
+        if ((state & RECORD_BUSY) && claim_owner(claim) != 0 && claim_abandoned(claim, head, false) &&
+            atomic_compare_exchange_strong(&record->claim, &claim, claim_word(head, 0))) {
+            atomic_store_explicit(&record->state, RECORD_PAD | (state & RECORD_LENGTH_MASK),
+                                  memory_order_release);
+            atomic_fetch_add(&shard->repaired_count, 1);
+            queue_notify(&ring->items_seq, &ring->empty_waiters);
+        }
+    }
+
+    if (reclaim != head && stalled_for(shard, STALL_TAIL, reclaim) >= REPAIR_WAIT_NS) {
+        record_header *record = ring_record(ring, reclaim);
+        unsigned int state = atomic_load_explicit(&record->state, memory_order_acquire);
+        uint64_t claim = atomic_load(&record->claim);
+        bool unstamped = claim_at(claim, reclaim) && !(claim & CLAIM_CONSUMER);
+        if ((state & RECORD_CONSUMED) ||
+            !(unstamped ? unstamped_abandoned(shard, reclaim, true) : claim_abandoned(claim, reclaim, true)) ||
+            !atomic_compare_exchange_strong(&record->claim, &claim, claim_word(reclaim, CLAIM_CONSUMER))) {
+            return;
+        }
+        if (!(state & RECORD_PAD)) {
+            atomic_fetch_add(&shard->repaired_count, 1);
+            atomic_fetch_add(&shard->extracted_count, 1);
+        }
+        atomic_fetch_or_explicit(&record->state, RECORD_CONSUMED, memory_order_release);
+        ring_reclaim(ring);
+        queue_notify(&ring->space_seq, &ring->full_waiters);
+    }
+}
+
+/* Blocking ring_reserve() on a shard's byte ring, same spin-then-futex scheme as queue_put(). NULL once terminate is set. */
+void *ring_reserve_wait(queue *shard, size_t len) {
+    byte_ring *ring = queue_bytes(shard);
+    void *payload;
+
+    for (int spin = 0; !(payload = ring_reserve(ring, len)); spin++) {
+        if (terminate) {
+            return NULL;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&ring->space_seq);
+        atomic_fetch_add(&ring->full_waiters, 1);
+        payload = ring_reserve(ring, len);
+        if (payload) {
+            atomic_fetch_sub(&ring->full_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->space_seq, seen);
+        atomic_fetch_sub(&ring->full_waiters, 1);
+        ring_repair(shard);
+    }
+    return payload;
+}
+
+/* Blocking ring_peek() on a shard's byte ring. NULL once terminate is set. */
+void *ring_peek_wait(queue *shard, size_t *len) {
+    byte_ring *ring = queue_bytes(shard);
+    void *payload;
+
+    for (int spin = 0; !(payload = ring_peek(shard, len)); spin++) {
+        if (terminate) {
+            return NULL;
+        }
+        if (spin < SPIN_TRIES) {
+            continue;
+        }
+
+        unsigned int seen = atomic_load(&ring->items_seq);
+        atomic_fetch_add(&ring->empty_waiters, 1);
+        payload = ring_peek(shard, len);
+        if (payload) {
+            atomic_fetch_sub(&ring->empty_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->items_seq, seen);
+        atomic_fetch_sub(&ring->empty_waiters, 1);
+        ring_repair(shard);
+    }
+    return payload;
+}
+
+/* Repair pass over a shard of either kind, for waits that are not tied to one ring. */
+void queue_repair(queue *shard, cursor *reader) {
+    if (queue_byte_mode(shard)) {
+        ring_repair(shard);
+    } else {
+        slot_repair(shard, reader);
+    }
+}
+
+/* Fill level of a shard in eighths, OCCUPANCY_BUCKETS meaning full. */
+size_t queue_fill_bucket(queue *ring) {
+    size_t used = queue_byte_mode(ring) ? ring_used(queue_bytes(ring)) : queue_length(ring);
+    size_t size = queue_byte_mode(ring) ? ring->byte_ring_size : ring->capacity;
+    size_t bucket = used * OCCUPANCY_BUCKETS / size;
+    return bucket > OCCUPANCY_BUCKETS ? OCCUPANCY_BUCKETS : bucket;
+}
+
+/* Counts n messages of bytes in total through ring for this worker's telemetry entry. */
+void stats_count(queue *ring, size_t n, size_t bytes) {
+    if (!self_stats) {
+        return;
+    }
+    uint64_t before = stat_load(&self_stats->messages);
+    stat_add(&self_stats->messages, n);
+    stat_add(&self_stats->bytes, bytes);
+    if ((before + n) / OCCUPANCY_SAMPLE != before / OCCUPANCY_SAMPLE) {
+        stat_add(&self_stats->occupancy[queue_fill_bucket(ring)], 1);
+    }
+}
+
+/* Snapshot for main's stats view and bin/qstat; only loads from the segment. */
+void print_queue_stats(FILE *out, queue *segment) {
+    for (size_t i = 0; i < segment->shards; i++) {
+        queue *ring = queue_shard(segment, i);
+        if (queue_byte_mode(ring)) {
+            fprintf(out, "Shard %zu: %zu of %zu bytes used", i, ring_used(queue_bytes(ring)), ring->byte_ring_size);
+        } else {
+            fprintf(out, "Shard %zu: %zu of %zu slots used", i, queue_length(ring), ring->capacity);
+        }
+        fprintf(out, ", added %d, extracted %d", atomic_load(&ring->added_count), atomic_load(&ring->extracted_count));
+        int repaired = atomic_load(&ring->repaired_count);
+        fprintf(out, repaired ? ", repaired %d\n" : "\n", repaired);
+    }
+
+    telemetry *stats = queue_telemetry(segment);
+    telemetry_print_side(out, "Producers", stats->producers, &stats->retired_producers);
+    telemetry_print_side(out, "Consumers", stats->consumers, &stats->retired_consumers);
+}
+
+/* The queue's shm object: QUEUE_SHM_NAME unless QUEUE_SHM_ENV names another (bin/bench does). */
+const char *queue_shm_name(void) {
+    const char *name = getenv(QUEUE_SHM_ENV);
+    return name && *name ? name : QUEUE_SHM_NAME;
+}
+
+/*
+ * Maps the header first, then the whole segment at the size the header
+ * describes. In durable mode main passes the queue file in QUEUE_FILE_ENV.
+ * bin/qstat maps it read-only (prot PROT_READ).
+ */
+void *map_queue(int prot) {
+    const char *file = getenv(QUEUE_FILE_ENV);
+    int flags = (prot & PROT_WRITE) ? O_RDWR : O_RDONLY;
+    int fd = file ? open(file, flags) : shm_open(queue_shm_name(), flags, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror(file ? file : "shm_open");
+        exit(EXIT_FAILURE);
     }
     
-    msg->hash = stored_hash;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)st.st_size < sizeof(queue)) {
+        fprintf(stderr, "shm: segment too small for a queue header\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    queue *header = mmap(NULL, sizeof(queue), PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    if (!queue_check(header, (size_t)st.st_size)) {
+        exit(EXIT_FAILURE);
+    }
+    size_t total_size = header->total_size;
+    munmap(header, sizeof(queue));
+    
+    void *ptr = mmap(NULL, total_size, prot, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    
+    close(fd);
+    return ptr;
 }
 
 void *init_shared_memory() {
-    int fd = shm_open("message_queue", O_RDWR, S_IRUSR | S_IWUSR);
+    return map_queue(PROT_READ | PROT_WRITE);
+}
+
+/*
+ * Worker options: -k <batch> messages per queue operation, -x <index> to
+ * run as benchmark worker number index, -c <cpu> to pin to a CPU.
+ * Consumers also take -s <shard,shard,...> to read only those shards
+ * (all by default) and -w to steal from the other shards when idle.
+ * Benchmark producers take -R <corpus> to replay recorded messages.
+ */
+typedef struct {
+    size_t batch;
+    int bench_index;
+    int cpu;
+    uint64_t shard_mask;
+    bool steal;
+    const char *corpus;
+} worker_options;
+
+uint64_t parse_shard_list(const char *list) {
+    uint64_t mask = 0;
+    
+    while (*list) {
+        char *end;
+        unsigned long shard = strtoul(list, &end, 10);
+        if (end == list) {
+            break;
+        }
+        if (shard < MAX_SHARDS) {
+            mask |= 1ull << shard;
+        }
+        list = *end == ',' ? end + 1 : end;
+    }
+    return mask;
+}
+
+worker_options parse_worker_options(int argc, char *argv[]) {
+    worker_options options = {1, -1, -1, 0, false, NULL};
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "k:x:c:s:wR:")) != -1) {
+        switch (opt) {
+            case 's':
+                options.shard_mask = parse_shard_list(optarg);
+                break;
+            case 'w':
+                options.steal = true;
+                break;
+            case 'k':
+                options.batch = strtoul(optarg, NULL, 10);
+                break;
+            case 'x':
+                options.bench_index = atoi(optarg);
+                break;
+            case 'c':
+                options.cpu = atoi(optarg);
+                break;
+            case 'R':
+                options.corpus = optarg;
+                break;
+        }
+    }
+    if (options.batch == 0) {
+        options.batch = 1;
+    }
+    if (options.batch > MAX_BATCH) {
+        options.batch = MAX_BATCH;
+    }
+    return options;
+}
+
+/* Creates (or truncates) a shm object of size bytes and maps it. */
+void *create_shared_memory(const char *name, size_t size) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
     if (fd == -1) {
         perror("shm_open");
         exit(EXIT_FAILURE);
     }
     
-    void *ptr = mmap(NULL, sizeof(queue), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ftruncate(fd, (off_t)size) == -1) {
+        perror("ftruncate");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (ptr == MAP_FAILED) {
         perror("mmap");
+        close(fd);
         exit(EXIT_FAILURE);
     }
     
@@ -85,8 +1673,9 @@ void *init_shared_memory() {
     return ptr;
 }
 
+/* SIGUSR1 stops a worker process, SIGUSR2 one worker_host thread. */
 void signal_handler(int sig) {
-    if (sig == SIGUSR1) {
+    if (sig == SIGUSR1 || sig == SIGUSR2) {
         terminate = 1;
     }
 }
@@ -102,23 +1691,13 @@ void initialize() {
     }
     
     q = (queue*)init_shared_memory();
-    
-    mutex = sem_open("message_mutex", O_RDWR);
-    free_space = sem_open("message_free_space", O_RDWR);
-    items = sem_open("message_items", O_RDWR);
-    
-    if (mutex == SEM_FAILED || free_space == SEM_FAILED || items == SEM_FAILED) {
-        perror("sem_open");
-        exit(EXIT_FAILURE);
+    if (q->features & QUEUE_FEATURE_EVENTFD) {
+        queue_event_fd = event_connect(EVENT_SOCKET_NAME);
     }
 }
 
 void cleanup() {
-    if (sem_close(mutex) == -1 || sem_close(free_space) == -1 || sem_close(items) == -1) {
-        perror("sem_close");
-    }
-    
-    if (munmap(q, sizeof(queue)) == -1) {
+    if (munmap(q, q->total_size) == -1) {
         perror("munmap");
     }
 }
@@ -1,16 +1,31 @@
 #include "header.h"
+#include "durable.h"
+#include "autoscale.h"
+#include <poll.h>
 
-volatile sig_atomic_t terminate = 0;
+_Thread_local volatile sig_atomic_t terminate = 0;
 pid_t producers[MAX_AMOUNT];
 pid_t consumers[MAX_AMOUNT];
+/* Set for the consumers the autoscaler started; it retires only those. */
+bool autoscaled[MAX_AMOUNT];
 int count_producers = 0;
 int count_consumers = 0;
 
 static pid_t ppid;
+static char batch_arg[16] = "1";
+static const char *queue_file = NULL;
+static durable_flusher flusher;
+static event_server events;
+static autoscaler scaler;
+static bool autoscaling = false;
+/* The menu and the autoscaler thread both add and remove consumers. */
+static pthread_mutex_t consumers_lock = PTHREAD_MUTEX_INITIALIZER;
+/* bin/worker_host, started on first use; its stdin is the write end of host_control. */
+static pid_t host_pid = 0;
+static FILE *host_control = NULL;
+static int thread_producers = 0;
+static int thread_consumers = 0;
 queue *q;
-sem_t *mutex;
-sem_t *free_space;
-sem_t *items;
 
 
 void display_menu() {
@@ -21,9 +36,14 @@ void display_menu() {
     printf("\n║ 2. Удалить производителя   ║");
     printf("\n║ 3. Создать потребителя     ║");
     printf("\n║ 4. Удалить потребителя     ║");
+    printf("\n║ 5. Добавить поток-произв.  ║");
+    printf("\n║ 6. Удалить поток-произв.   ║");
+    printf("\n║ 7. Добавить поток-потреб.  ║");
+    printf("\n║ 8. Удалить поток-потреб.   ║");
     printf("\n║                            ║");
     printf("\n║ m. Показать меню           ║");
     printf("\n║ l. Список процессов        ║");
+    printf("\n║ s. Статистика очереди      ║");
     printf("\n║ q. Выход                   ║");
     printf("\n╚════════════════════════════╝");
     printf("\nВыберите действие: ");
@@ -44,6 +64,12 @@ void show_processes() {
     for (int i = 0; i < count_consumers; i++) {
         printf("\n│   %3d. PID: %-8d        │", i+1, consumers[i]);
     }
+    if (host_pid != 0) {
+        printf("\n├─────────────────────────────┤");
+        printf("\n│ Хост потоков: %-8d      │", host_pid);
+        printf("\n│   производителей: %-4d      │", thread_producers);
+        printf("\n│   потребителей:   %-4d      │", thread_consumers);
+    }
     printf("\n└─────────────────────────────┘\n");
 }
 
@@ -63,7 +89,7 @@ void create_prod() {
     
     if (pid == 0) {
         char producer_path[] = "./bin/producer";
-        execl(producer_path, producer_path, NULL);
+        execl(producer_path, producer_path, "-k", batch_arg, NULL);
         perror("execl");
         exit(EXIT_FAILURE);
     }
@@ -107,23 +133,30 @@ void create_con() {
     
     if (pid == 0) {
         char consumer_path[] = "./bin/consumer";
-        execl(consumer_path, consumer_path, NULL);
+        if (q->shards > 1) {
+            /* Home shard round-robin, stealing from the others when idle. */
+            char shard_arg[16];
+            snprintf(shard_arg, sizeof(shard_arg), "%u", (unsigned int)count_consumers % q->shards);
+            execl(consumer_path, consumer_path, "-k", batch_arg, "-s", shard_arg, "-w", NULL);
+        } else {
+            execl(consumer_path, consumer_path, "-k", batch_arg, NULL);
+        }
         perror("execl");
         exit(EXIT_FAILURE);
     }
     
+    autoscaled[count_consumers] = false;
     consumers[count_consumers++] = pid;
     printf("CONSUMER CREATED. PID: %d\n", pid);
     printf("\n");
 }
 
-void del_con() {
-    if (count_consumers == 0) {
-        fprintf(stderr, "NO CONSUMERS FOUND\n");
-        return;
-    }
-    
-    pid_t pid = consumers[--count_consumers];
+/* Stops consumers[index]; the later ones shift down to keep their order. */
+void del_con_at(int index) {
+    pid_t pid = consumers[index];
+    count_consumers--;
+    memmove(&consumers[index], &consumers[index + 1], (size_t)(count_consumers - index) * sizeof(consumers[0]));
+    memmove(&autoscaled[index], &autoscaled[index + 1], (size_t)(count_consumers - index) * sizeof(autoscaled[0]));
     if (kill(pid, SIGUSR1) == -1) {
         perror("kill");
     }
@@ -137,44 +170,179 @@ void del_con() {
     printf("\n");
 }
 
-void initialize_queue() {
-    ppid = getpid();
-    
-    int fd = shm_open("message_queue", O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    if (fd == -1) {
-        perror("shm_open");
+void del_con() {
+    if (count_consumers == 0) {
+        fprintf(stderr, "NO CONSUMERS FOUND\n");
+        return;
+    }
+    del_con_at(count_consumers - 1);
+}
+
+void start_worker_host() {
+    int control[2];
+    if (pipe2(control, O_CLOEXEC) == -1) {
+        perror("pipe2");
         exit(EXIT_FAILURE);
     }
     
-    if (ftruncate(fd, sizeof(queue)) == -1) {
-        perror("ftruncate");
-        close(fd);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
         exit(EXIT_FAILURE);
     }
     
-    void* ptr = mmap(NULL, sizeof(queue), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (ptr == MAP_FAILED) {
-        perror("mmap");
-        close(fd);
+    if (pid == 0) {
+        char host_path[] = "./bin/worker_host";
+        dup2(control[0], STDIN_FILENO);
+        execl(host_path, host_path, "-k", batch_arg, NULL);
+        perror("execl");
         exit(EXIT_FAILURE);
     }
     
-    close(fd);
+    close(control[0]);
+    host_control = fdopen(control[1], "w");
+    if (!host_control) {
+        perror("fdopen");
+        exit(EXIT_FAILURE);
+    }
+    /* A host that died must not take main down with SIGPIPE. */
+    signal(SIGPIPE, SIG_IGN);
+    host_pid = pid;
+    printf("WORKER HOST CREATED. PID: %d\n", pid);
+}
+
+/* Sends one control line (see worker_host.c) and counts the threads. */
+void host_command(char op, char role) {
+    int *count = role == 'p' ? &thread_producers : &thread_consumers;
+    if (op == '-' && *count == 0) {
+        fprintf(stderr, "NO %s THREADS FOUND\n", role == 'p' ? "PRODUCER" : "CONSUMER");
+        return;
+    }
+    if (host_pid == 0) {
+        start_worker_host();
+    }
     
-    q = (queue*)ptr;
-    memset(q, 0, sizeof(queue));
+    if (fprintf(host_control, "%c%c\n", op, role) < 0 || fflush(host_control) == EOF) {
+        perror("worker host");
+        return;
+    }
+    *count += op == '+' ? 1 : -1;
+}
+
+void stop_worker_host() {
+    if (host_pid == 0) {
+        return;
+    }
+    /* EOF on its stdin stops every thread, then the host exits. */
+    fclose(host_control);
+    if (waitpid(host_pid, NULL, 0) == -1) {
+        perror("waitpid worker host");
+    }
+    host_pid = 0;
+}
+
+int locked_count_consumers() {
+    pthread_mutex_lock(&consumers_lock);
+    int count = count_consumers;
+    pthread_mutex_unlock(&consumers_lock);
+    return count;
+}
+
+void locked_create_con() {
+    pthread_mutex_lock(&consumers_lock);
+    create_con();
+    pthread_mutex_unlock(&consumers_lock);
+}
+
+void locked_del_con() {
+    pthread_mutex_lock(&consumers_lock);
+    del_con();
+    pthread_mutex_unlock(&consumers_lock);
+}
+
+int locked_count_autoscaled() {
+    pthread_mutex_lock(&consumers_lock);
+    int count = 0;
+    for (int i = 0; i < count_consumers; i++) {
+        count += autoscaled[i];
+    }
+    pthread_mutex_unlock(&consumers_lock);
+    return count;
+}
+
+void autoscale_create_con() {
+    pthread_mutex_lock(&consumers_lock);
+    int before = count_consumers;
+    create_con();
+    if (count_consumers > before) {
+        autoscaled[before] = true;
+    }
+    pthread_mutex_unlock(&consumers_lock);
+}
+
+/* Retires the newest consumer the autoscaler started; the ones added from the menu stay. */
+void autoscale_del_con() {
+    pthread_mutex_lock(&consumers_lock);
+    for (int i = count_consumers - 1; i >= 0; i--) {
+        if (autoscaled[i]) {
+            del_con_at(i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&consumers_lock);
+}
+
+/* Redraws the telemetry every second until Enter is pressed. */
+void show_stats() {
+    struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+    int c;
     
-    mutex = sem_open("message_mutex", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR, 1);
-    free_space = sem_open("message_free_space", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR, BUFFER_SIZE);
-    items = sem_open("message_items", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR, 0);
+    while ((c = getchar()) != '\n' && c != EOF);
+    for (;;) {
+        printf("\033[H\033[J");
+        telemetry_reap(queue_telemetry(q));
+        print_queue_stats(stdout, q);
+        if (autoscaling) {
+            printf("Autoscaler: %d..%d consumers, %d running, %" PRIu64 " decision(s) in %s\n",
+                   scaler.min, scaler.max, locked_count_consumers(), scaler.decisions, AUTOSCALE_LOG);
+        }
+        printf("\nEnter - назад в меню\n");
+        fflush(stdout);
+        
+        int ready = poll(&input, 1, 1000);
+        if (ready == -1 && errno != EINTR) {
+            perror("poll");
+            return;
+        }
+        if (ready > 0) {
+            while ((c = getchar()) != '\n' && c != EOF);
+            return;
+        }
+    }
+}
+
+void initialize_queue(const queue *layout) {
+    ppid = getpid();
     
-    if (mutex == SEM_FAILED || free_space == SEM_FAILED || items == SEM_FAILED) {
-        perror("sem_open");
-        exit(EXIT_FAILURE);
+    if (queue_file) {
+        size_t pending;
+        setenv(QUEUE_FILE_ENV, queue_file, 1);
+        q = durable_open(queue_file, layout, &pending);
+        durable_start(&flusher, q);
+        printf("Durable queue in %s, %zu message(s) recovered\n", queue_file, pending);
+        return;
     }
+    
+    unsetenv(QUEUE_FILE_ENV);
+    q = (queue*)create_shared_memory(queue_shm_name(), layout->total_size);
+    queue_init(q, layout);
 }
 
 void cleanup_resources() {
+    if (autoscaling) {
+        autoscale_stop(&scaler);
+    }
+    
     for (int i = 0; i < count_producers; i++) {
         if (kill(producers[i], SIGUSR1) == -1) {
             perror("kill producer");
@@ -188,22 +356,22 @@ void cleanup_resources() {
         }
         waitpid(consumers[i], NULL, 0);
     }
+    stop_worker_host();
     
-    if (sem_close(mutex) == -1 || sem_close(free_space) == -1 || sem_close(items) == -1) {
-        perror("sem_close");
+    if (queue_file) {
+        durable_stop(&flusher);
     }
-    
-    if (sem_unlink("message_mutex") == -1 || 
-        sem_unlink("message_free_space") == -1 || 
-        sem_unlink("message_items") == -1) {
-        perror("sem_unlink");
+    if (q->features & QUEUE_FEATURE_EVENTFD) {
+        event_server_stop(&events);
     }
     
-    if (munmap(q, sizeof(queue)) == -1) {
+    if (munmap(q, q->total_size) == -1) {
         perror("munmap");
     }
     
-    if (shm_unlink("message_queue") == -1) {
+    if (queue_file) {
+        printf("Queue kept in %s after %" PRIu64 " commit(s)\n", queue_file, flusher.commits);
+    } else if (shm_unlink(queue_shm_name()) == -1) {
         perror("shm_unlink");
     }
     
@@ -220,15 +388,149 @@ char get_option() {
             continue;
         }
         
-        if ((opt >= '1' && opt <= '4') || opt == 'm' || opt == 'l' || opt == 'q') {
+        if ((opt >= '1' && opt <= '8') || opt == 'm' || opt == 'l' || opt == 's' || opt == 'q') {
             break;
         }
     }
     return opt;
 }
 
-int main() {
-    initialize_queue();
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-b | -B] [-n slots] [-p max_payload] [-r ring_bytes] [-k batch]\n"
+                    "          [-a djb|crc32c] [-s shards] [-d file [-y]] [-e] [-A min:max]\n", program);
+    fprintf(stderr, "  -b  byte ring with variable-length records\n");
+    fprintf(stderr, "  -B  broadcast: every consumer sees every message (%d at most)\n", MAX_SUBSCRIBERS);
+    fprintf(stderr, "  -n  slot count, rounded up to a power of two (default %d)\n", BUFFER_SIZE);
+    fprintf(stderr, "  -p  largest payload in bytes, 1..%d (default %d)\n", SIZE, SIZE);
+    fprintf(stderr, "  -r  byte ring size, rounded up to a power of two (default %d)\n", BYTE_RING_SIZE);
+    fprintf(stderr, "  -k  messages per queue operation in workers, 1..%d (default 1)\n", MAX_BATCH);
+    fprintf(stderr, "  -a  message checksum (default crc32c)\n");
+    fprintf(stderr, "  -s  independent rings, messages routed by type (default 1, max %d)\n", MAX_SHARDS);
+    fprintf(stderr, "  -d  keep the queue in file, resumed on the next start (slot rings only)\n");
+    fprintf(stderr, "  -y  producers wait until a commit covers each put (with -d)\n");
+    fprintf(stderr, "  -e  consumers wait in epoll on an eventfd instead of a futex\n");
+    fprintf(stderr, "  -A  keep min..max consumers, following the queue fill (log in %s)\n", AUTOSCALE_LOG);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t features = 0;
+    unsigned long capacity = BUFFER_SIZE;
+    unsigned long max_payload = SIZE;
+    unsigned long ring_bytes = BYTE_RING_SIZE;
+    int opt;
+    
+    unsigned long batch = 1;
+    int hash_algo = HASH_CRC32C;
+    unsigned long shards = 1;
+    
+    while ((opt = getopt(argc, argv, "bBn:p:r:k:a:s:d:yeA:")) != -1) {
+        switch (opt) {
+            case 'b':
+                features |= QUEUE_FEATURE_BYTE_RING;
+                break;
+            case 'B':
+                features |= QUEUE_FEATURE_BROADCAST;
+                break;
+            case 'n':
+                capacity = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                max_payload = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                ring_bytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'k':
+                batch = strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                hash_algo = parse_hash_algo(optarg);
+                break;
+            case 's':
+                shards = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                features |= QUEUE_FEATURE_DURABLE;
+                queue_file = optarg;
+                break;
+            case 'y':
+                features |= QUEUE_FEATURE_SYNC_COMMIT;
+                break;
+            case 'e':
+                features |= QUEUE_FEATURE_EVENTFD;
+                break;
+            case 'A':
+                if (sscanf(optarg, "%d:%d", &scaler.min, &scaler.max) != 2) {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                autoscaling = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    
+    if (capacity == 0 || capacity > MAX_CAPACITY || max_payload == 0 || max_payload > SIZE ||
+        ring_bytes > MAX_BYTE_RING_SIZE || batch == 0 || batch > MAX_BATCH ||
+        hash_algo == -1 || shards == 0 || shards > MAX_SHARDS ||
+        (autoscaling && (scaler.min < 0 || scaler.max < scaler.min || scaler.max >= MAX_AMOUNT - 1))) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if ((features & QUEUE_FEATURE_BROADCAST) && ((features & QUEUE_FEATURE_BYTE_RING) || shards > 1)) {
+        fprintf(stderr, "Broadcast mode works on a single slot ring (no -b, no -s)\n");
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (autoscaling && (features & QUEUE_FEATURE_BROADCAST)) {
+        fprintf(stderr, "Autoscaling does not apply to broadcast: every consumer reads every message\n");
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if ((features & QUEUE_FEATURE_SYNC_COMMIT) && !(features & QUEUE_FEATURE_DURABLE)) {
+        fprintf(stderr, "-y waits for commits of a queue file (needs -d)\n");
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if ((features & QUEUE_FEATURE_DURABLE) && (features & (QUEUE_FEATURE_BYTE_RING | QUEUE_FEATURE_BROADCAST))) {
+        fprintf(stderr, "Durable mode works on slot rings (no -b, no -B)\n");
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    
+    snprintf(batch_arg, sizeof(batch_arg), "%lu", batch);
+    
+    queue layout;
+    queue_layout(&layout, capacity, max_payload, ring_bytes, features, shards);
+    layout.hash_algo = (uint32_t)hash_algo;
+    initialize_queue(&layout);
+    /* A recovered queue file keeps the features it was created with. */
+    if (q->features & QUEUE_FEATURE_EVENTFD) {
+        event_server_start(&events, EVENT_SOCKET_NAME);
+    }
+    
+    if (queue_byte_mode(q)) {
+        printf("Queue: %u x byte ring of %zu bytes, payload up to %u, shm %zu bytes\n",
+               q->shards, q->byte_ring_size, q->max_payload, q->total_size);
+    } else if (queue_broadcast_mode(q)) {
+        printf("Queue: broadcast ring of %zu slots of %zu bytes, payload up to %u, shm %zu bytes\n",
+               q->capacity, q->slot_size, q->max_payload, q->total_size);
+    } else {
+        printf("Queue: %u x %zu slots of %zu bytes, payload up to %u, shm %zu bytes\n",
+               q->shards, q->capacity, q->slot_size, q->max_payload, q->total_size);
+    }
+    printf("Checksum: %s%s\n", hash_algo_name((int)q->hash_algo),
+           q->hash_algo == HASH_CRC32C && crc32c_hw_available() ? " (SSE4.2)" : "");
+    if (autoscaling) {
+        scaler.count = locked_count_consumers;
+        scaler.spawned = locked_count_autoscaled;
+        scaler.grow = autoscale_create_con;
+        scaler.shrink = autoscale_del_con;
+        autoscale_start(&scaler, q, AUTOSCALE_LOG);
+        printf("Autoscaler: %d..%d consumers, decisions logged to %s\n", scaler.min, scaler.max, AUTOSCALE_LOG);
+    }
 
     display_menu();
     
@@ -242,7 +544,13 @@ int main() {
                 display_menu();
                 break;
             case 'l':
+                pthread_mutex_lock(&consumers_lock);
                 show_processes();
+                pthread_mutex_unlock(&consumers_lock);
+                break;
+            case 's':
+                show_stats();
+                display_menu();
                 break;
             case '1':
                 create_prod();
@@ -251,10 +559,22 @@ int main() {
                 del_prod();
                 break;
             case '3':
-                create_con();
+                locked_create_con();
                 break;
             case '4':
-                del_con();
+                locked_del_con();
+                break;
+            case '5':
+                host_command('+', 'p');
+                break;
+            case '6':
+                host_command('-', 'p');
+                break;
+            case '7':
+                host_command('+', 'c');
+                break;
+            case '8':
+                host_command('-', 'c');
                 break;
             case 'q':
                 cleanup_resources();
@@ -1,72 +1,39 @@
-#include "header.h"
-#include "time.h"
+#include "producer.h"
 
 queue *q;
-sem_t *mutex;
-sem_t *free_space;
-sem_t *items;
-volatile sig_atomic_t terminate = 0;
+_Thread_local volatile sig_atomic_t terminate = 0;
 
-void create_message(message *msg) {
-    msg->type = rand() % 256;
-    
-    int rand_size = rand() % 257;
-    while (rand_size == 0) {
-        rand_size = rand() % 257;
+int main(int argc, char *argv[]) {
+    worker_options options = parse_worker_options(argc, argv);
+    size_t batch = options.batch;
+    initialize();
+    if (!telemetry_join(queue_telemetry(q), true)) {
+        cleanup();
+        return EXIT_FAILURE;
     }
     
-    msg->size = (rand_size == 256) ? 0 : rand_size;
-    
-    for (int i = 0; i < (msg->size == 0 ? 256 : msg->size); i++) {
-        msg->data[i] = 32 + rand() % 95; 
+    if (options.cpu >= 0) {
+        pin_to_cpu(options.cpu);
     }
-    
-    msg->hash = 0; 
-    msg->hash = calculate_hash(msg);
-}
-
-int main() {
-    initialize();
-    
-    srand((unsigned int)time(NULL) ^ getpid());
-    
-    printf("Producer started (PID: %d)\n", getpid());
-    
-    while (!terminate) {
-        message msg;
-        create_message(&msg);
-        
-        int value;
-        if (sem_getvalue(free_space, &value) == 0 && value == 0) {
-            fprintf(stderr, "Producer (PID: %d) waiting: queue is full\n", getpid());
+    if (options.bench_index >= 0 && options.bench_index < MAX_BENCH_WORKERS) {
+        corpus replay;
+        if (options.corpus) {
+            corpus_open(&replay, options.corpus);
         }
-        
-        sem_wait(free_space);
-        
-        if (terminate) {
-            sem_post(free_space);
-            break;
+        bench_shared *bench = bench_attach();
+        bench_wait_start(bench);
+        producer_benchmark(&bench->producers[options.bench_index], batch, options.corpus ? &replay : NULL);
+        munmap(bench, sizeof(bench_shared));
+        if (options.corpus) {
+            corpus_close(&replay);
         }
-        sem_wait(mutex);
-        
-        q->buffer[q->tail] = msg;
-        q->tail = (q->tail + 1) % BUFFER_SIZE;
-        q->added_count++;
-        
-        int current_count = q->added_count;
-        
-        sem_post(mutex);
-        
-        sem_post(items);
-        
-        printf("PRODUCER %d: TYPE=%d HASH=%04X SIZE=%d ADDED=%d\n", 
-        getpid(), msg.type, msg.hash, msg.size == 0 ? 256 : msg.size,
-        current_count);
-        
-        sleep(1 + rand() % 3);
+        telemetry_leave(queue_telemetry(q), true);
+        cleanup();
+        return 0;
     }
     
-    printf("Producer (PID: %d) terminating\n", getpid());
+    run_producer(batch);
+    telemetry_leave(queue_telemetry(q), true);
     cleanup();
     
     return 0;
@@ -0,0 +1,247 @@
+#ifndef LAB04_PRODUCER_H
+#define LAB04_PRODUCER_H
+
+#include "header.h"
+#include "bench.h"
+#include "generator.h"
+#include "corpus.h"
+#include "durable.h"
+
+/* This producer's generator; rand() would serialize worker_host threads on its lock. */
+static _Thread_local rng producer_rng;
+
+void producer_seed() {
+    rng_seed(&producer_rng, monotonic_ns() ^ ((uint64_t)worker_id() << 32));
+}
+
+/* On a durable queue with -y a put only counts once a commit covers it. */
+bool put_committed(queue *shard) {
+    return !(shard->features & QUEUE_FEATURE_SYNC_COMMIT) || durable_wait_commit(shard);
+}
+
+/* 1..max_payload, as configured in the shm header. */
+int random_size() {
+    return 1 + (int)rng_below(&producer_rng, q->max_payload);
+}
+
+/* A random type that routes to the given shard. */
+uint8_t random_type_on(size_t shard) {
+    size_t types = (256 - shard + q->shards - 1) / q->shards;
+    return (uint8_t)(shard + q->shards * rng_below(&producer_rng, (uint32_t)types));
+}
+
+void fill_message(message *msg, uint8_t type, int rand_size) {
+    msg->type = type;
+    msg->algo = (uint8_t)q->hash_algo;
+    
+    msg->size = (rand_size == 256) ? 0 : rand_size;
+    fill_printable(&producer_rng, msg->data, (size_t)rand_size);
+    
+    msg->hash = 0; 
+    msg->hash = calculate_hash(msg);
+}
+
+void create_message(message *msg) {
+    fill_message(msg, (uint8_t)rng_next(&producer_rng), random_size());
+}
+
+/*
+ * Byte-ring mode: the message is built directly in its record. Only the
+ * header is copied out (into *sent) for the log line, because after the
+ * commit a consumer may release the record at any moment.
+ */
+int put_in_place(message *sent) {
+    uint8_t type = (uint8_t)rng_next(&producer_rng);
+    int rand_size = random_size();
+    size_t len = MESSAGE_HEADER + rand_size;
+    queue *shard = queue_route(q, type);
+    
+    if (ring_used(queue_bytes(shard)) + RECORD_SIZE(len) > shard->byte_ring_size) {
+        fprintf(stderr, "Producer (PID: %d) waiting: queue is full\n", worker_id());
+    }
+    
+    message *msg = ring_reserve_wait(shard, len);
+    if (msg == NULL) {
+        return -1;
+    }
+    
+    fill_message(msg, type, rand_size);
+    memcpy(sent, msg, MESSAGE_HEADER);
+    ring_commit(queue_bytes(shard), msg);
+    queue_doorbell(q);
+    stats_count(shard, 1, len);
+    
+    return atomic_fetch_add(&shard->added_count, 1) + 1;
+}
+
+int put_copy(message *msg) {
+    create_message(msg);
+    queue *shard = queue_route(q, msg->type);
+    
+    if (queue_length(shard) >= shard->capacity) {
+        fprintf(stderr, "Producer (PID: %d) waiting: queue is full\n", worker_id());
+    }
+    
+    int count = queue_put(shard, msg);
+    queue_doorbell(q);
+    if (count == -1) {
+        return -1;
+    }
+    stats_count(shard, 1, message_length(msg));
+    return put_committed(shard) ? count : -1;
+}
+
+void print_sent(const message *msg, int added_count) {
+    printf("PRODUCER %d: TYPE=%d HASH=%04X SIZE=%d ADDED=%d\n", 
+    worker_id(), msg->type, msg->hash, msg->size == 0 ? 256 : msg->size,
+    added_count);
+}
+
+/*
+ * Batch mode: batch messages go in with as few CAS steps as the free space
+ * allows. A batch targets one shard, so its types are drawn from that shard.
+ */
+int put_batch(size_t batch) {
+    message msgs[MAX_BATCH];
+    size_t index = rng_below(&producer_rng, q->shards);
+    queue *shard = queue_shard(q, index);
+    for (size_t i = 0; i < batch; i++) {
+        fill_message(&msgs[i], random_type_on(index), random_size());
+    }
+    
+    if (queue_length(shard) + batch > shard->capacity) {
+        fprintf(stderr, "Producer (PID: %d) waiting: queue is full\n", worker_id());
+    }
+    
+    size_t put;
+    int last_count = queue_put_batch(shard, msgs, batch, &put);
+    queue_doorbell(q);
+    if (last_count == -1) {
+        return -1;
+    }
+    
+    size_t bytes = 0;
+    for (size_t i = 0; i < put; i++) {
+        bytes += message_length(&msgs[i]);
+        print_sent(&msgs[i], last_count - (int)(put - 1 - i));
+    }
+    stats_count(shard, put, bytes);
+    return put_committed(shard) ? last_count : -1;
+}
+
+/* Benchmark payload: max_payload bytes with the send time in the first 8. */
+void fill_timestamped(message *msg, uint8_t type) {
+    uint64_t sent = monotonic_ns();
+    
+    msg->type = type;
+    msg->algo = (uint8_t)q->hash_algo;
+    msg->size = q->max_payload == 256 ? 0 : (uint8_t)q->max_payload;
+    memcpy(msg->data, &sent, sizeof(sent));
+    msg->hash = 0;
+    msg->hash = calculate_hash(msg);
+}
+
+/*
+ * Replay: a corpus message copied as is, then re-typed for routing and
+ * stamped like fill_timestamped(). Returns its length.
+ */
+size_t fill_replayed(message *msg, const message *recorded, uint8_t type) {
+    size_t len = message_length(recorded);
+    uint64_t sent = monotonic_ns();
+    
+    memcpy(msg, recorded, len);
+    msg->type = type;
+    msg->algo = (uint8_t)q->hash_algo;
+    memcpy(msg->data, &sent, sizeof(sent));
+    msg->hash = 0;
+    msg->hash = calculate_hash(msg);
+    return len;
+}
+
+/*
+ * Benchmark mode: no sleeps and no output, just fill and put until SIGUSR1.
+ * Types cycle so that every shard gets an equal share. With replay the
+ * messages come from the corpus, otherwise they are all max_payload long.
+ */
+void producer_benchmark(bench_worker *stats, size_t batch, corpus *replay) {
+    message msgs[MAX_BATCH];
+    size_t full = MESSAGE_HEADER + q->max_payload;
+    uint8_t type = (uint8_t)worker_id();
+    memset(msgs, 0, sizeof(msgs));
+    
+    while (!terminate) {
+        queue *shard = queue_route(q, ++type);
+        
+        if (queue_byte_mode(q)) {
+            const message *recorded = replay ? corpus_next(replay) : NULL;
+            size_t len = recorded ? message_length(recorded) : full;
+            message *msg = ring_reserve_wait(shard, len);
+            if (msg == NULL) {
+                break;
+            }
+            if (recorded) {
+                fill_replayed(msg, recorded, type);
+            } else {
+                fill_timestamped(msg, type);
+            }
+            ring_commit(queue_bytes(shard), msg);
+            queue_doorbell(q);
+            stats->messages++;
+            stats_count(shard, 1, len);
+        } else {
+            for (size_t i = 0; i < batch; i++) {
+                if (replay) {
+                    fill_replayed(&msgs[i], corpus_next(replay), type);
+                } else {
+                    fill_timestamped(&msgs[i], type);
+                }
+            }
+            size_t put = 1;
+            int result = batch > 1 ? queue_put_batch(shard, msgs, batch, &put) : queue_put(shard, &msgs[0]);
+            queue_doorbell(q);
+            if (result == -1) {
+                break;
+            }
+            size_t bytes = 0;
+            for (size_t i = 0; i < put; i++) {
+                bytes += message_length(&msgs[i]);
+            }
+            stats->messages += put;
+            stats_count(shard, put, bytes);
+            if (!put_committed(shard)) {
+                break;
+            }
+        }
+    }
+}
+
+/* Interactive producer: a message (or a batch) every 1-3 s until terminate is set. */
+void run_producer(size_t batch) {
+    producer_seed();
+    printf("Producer started (PID: %d)\n", worker_id());
+    if (batch > 1 && queue_byte_mode(q)) {
+        fprintf(stderr, "Producer (PID: %d): batches are for slot mode, writing one record at a time\n", worker_id());
+    }
+    
+    while (!terminate) {
+        if (batch > 1 && !queue_byte_mode(q)) {
+            if (put_batch(batch) == -1) {
+                break;
+            }
+        } else {
+            message msg;
+            int current_count = queue_byte_mode(q) ? put_in_place(&msg) : put_copy(&msg);
+            if (current_count == -1) {
+                break;
+            }
+            
+            print_sent(&msg, current_count);
+        }
+        
+        sleep(1 + rng_below(&producer_rng, 3));
+    }
+    
+    printf("Producer (PID: %d) terminating\n", worker_id());
+}
+
+#endif // LAB04_PRODUCER_H
@@ -0,0 +1,47 @@
+#include "header.h"
+
+queue *q;
+_Thread_local volatile sig_atomic_t terminate = 0;
+
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-i seconds] [-d file]\n", program);
+    fprintf(stderr, "  -i  repeat every given number of seconds until interrupted\n");
+    fprintf(stderr, "  -d  read a durable queue file instead of the shm segment\n");
+}
+
+/*
+ * Prints the telemetry of a running queue. The segment is mapped
+ * read-only, so workers never see a write from here.
+ */
+int main(int argc, char *argv[]) {
+    unsigned int interval = 0;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "i:d:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                setenv(QUEUE_FILE_ENV, optarg, 1);
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    
+    q = (queue*)map_queue(PROT_READ);
+    for (;;) {
+        print_queue_stats(stdout, q);
+        if (interval == 0) {
+            break;
+        }
+        printf("\n");
+        fflush(stdout);
+        sleep(interval);
+    }
+    
+    munmap(q, q->total_size);
+    return EXIT_SUCCESS;
+}
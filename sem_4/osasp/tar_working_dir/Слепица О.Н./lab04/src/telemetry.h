@@ -0,0 +1,287 @@
+#ifndef LAB04_TELEMETRY_H
+#define LAB04_TELEMETRY_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TELEMETRY_WORKERS 256  // per role; at least a full worker_host
+#define TELEMETRY_LINE 64
+#define OCCUPANCY_BUCKETS 8
+#define OCCUPANCY_SAMPLE 64
+#define TELEMETRY_ORPHANS 64
+
+/*
+ * Counters of one producer or consumer, a process or a worker_host
+ * thread; pid holds its thread id. Only the owner writes them, with
+ * relaxed loads and stores and no read-modify-write, and every entry has
+ * its own cache lines, so counting costs the worker no shared traffic;
+ * readers (main's stats view, bin/qstat) only load. waits and blocked_ns
+ * cover futex sleeps, i.e. a full queue for producers and an empty one
+ * for consumers. occupancy is a histogram of the fill level, sampled
+ * once per OCCUPANCY_SAMPLE messages, in eighths of capacity. started is
+ * the thread's start time, which tells it from a later thread that got
+ * the same id (see worker_alive()); intent names the slots the worker is
+ * taking (see claim_intent() in header.h).
+ */
+typedef struct {
+    alignas(TELEMETRY_LINE) atomic_int pid;
+    _Atomic uint64_t started;
+    _Atomic uint64_t intent;
+    _Atomic uint64_t messages;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t waits;
+    _Atomic uint64_t blocked_ns;
+    _Atomic uint64_t checksum_failures;
+    _Atomic uint64_t occupancy[OCCUPANCY_BUCKETS + 1];
+} worker_stats;
+
+/*
+ * Lives once at the end of the segment; retired_* sum up the workers that
+ * have exited. orphan_intents keeps the last intents of the most recently
+ * reaped workers, which the entries themselves lose once they are reused.
+ */
+typedef struct {
+    worker_stats producers[TELEMETRY_WORKERS];
+    worker_stats consumers[TELEMETRY_WORKERS];
+    worker_stats retired_producers;
+    worker_stats retired_consumers;
+    _Atomic uint64_t orphan_intents[TELEMETRY_ORPHANS];
+    atomic_uint orphan_next;
+} telemetry;
+
+/* This worker's entry, NULL until telemetry_join(). */
+static _Thread_local worker_stats *self_stats = NULL;
+static _Thread_local int self_id = 0;
+
+/*
+ * Thread id: the pid for a single-threaded worker process, unique per
+ * worker_host thread. Cached, since queue operations stamp it on every
+ * slot they take; workers are started with exec, never a bare fork.
+ */
+int worker_id() {
+    if (self_id == 0) {
+        self_id = (int)syscall(SYS_gettid);
+    }
+    return self_id;
+}
+
+/*
+ * State letter and start time (clock ticks after boot) of a thread; false
+ * when there is no such thread. /proc/<tid> exists for every thread, even
+ * the ones it does not list. A stat that cannot be read for another
+ * reason (out of descriptors, say) reads as running, with start time 0.
+ */
+bool thread_stat(int tid, char *state, uint64_t *started) {
+    char path[32], stat[512];
+    *state = 'R';
+    *started = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", tid);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return errno != ENOENT && errno != ESRCH;
+    }
+    ssize_t n = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (n <= 0) {
+        return n == -1 && errno != ESRCH;
+    }
+    stat[n] = '\0';
+
+    /* comm may contain anything, so the fields are counted from its closing parenthesis. */
+    const char *fields = strrchr(stat, ')');
+    unsigned long long start;
+    if (fields && sscanf(fields + 1, " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+                         state, &start) == 2) {
+        *started = start;
+    }
+    return true;
+}
+
+/*
+ * False once the thread has exited, a zombie nobody waited for included.
+ * Thread ids are reused: a thread that now has the id of a worker listed
+ * in stats is that worker only if it started at the time the entry
+ * records. A worker without an entry is judged by its id alone.
+ */
+bool worker_alive(telemetry *stats, int tid) {
+    char state;
+    uint64_t started;
+    if (!thread_stat(tid, &state, &started) || state == 'Z' || state == 'X') {
+        return false;
+    }
+
+    bool listed = false;
+    for (size_t i = 0; i < 2 * TELEMETRY_WORKERS; i++) {
+        worker_stats *entry = i < TELEMETRY_WORKERS ? &stats->producers[i] : &stats->consumers[i - TELEMETRY_WORKERS];
+        if (atomic_load(&entry->pid) == tid) {
+            uint64_t known = atomic_load(&entry->started);
+            if (known == 0 || started == 0 || known == started) {
+                return true;
+            }
+            listed = true;
+        }
+    }
+    return !listed;
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Single-writer increment. */
+void stat_add(_Atomic uint64_t *counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+uint64_t stat_load(_Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/*
+ * Takes a free entry for this worker and makes it self_stats. Repair can
+ * only trace a worker through its entry, so a worker that gets none must
+ * not touch the queue: NULL, with a message, when the table is full.
+ */
+worker_stats *telemetry_join(telemetry *stats, bool producer) {
+    worker_stats *table = producer ? stats->producers : stats->consumers;
+
+    for (size_t i = 0; i < TELEMETRY_WORKERS; i++) {
+        int free_pid = 0;
+        if (atomic_compare_exchange_strong(&table[i].pid, &free_pid, worker_id())) {
+            char state;
+            uint64_t started;
+            thread_stat(worker_id(), &state, &started);
+            atomic_store(&table[i].intent, 0);
+            atomic_store(&table[i].started, started);
+            self_stats = &table[i];
+            return self_stats;
+        }
+    }
+    fprintf(stderr, "%s (PID: %d): all %d telemetry entries are taken, not starting\n",
+            producer ? "Producer" : "Consumer", worker_id(), TELEMETRY_WORKERS);
+    return NULL;
+}
+
+/* Counter of an exiting worker into a total that other processes add to as well. */
+void stat_move(_Atomic uint64_t *total, _Atomic uint64_t *counter) {
+    atomic_fetch_add_explicit(total, stat_load(counter), memory_order_relaxed);
+    atomic_store_explicit(counter, 0, memory_order_relaxed);
+}
+
+/* Moves this worker's counters into the retired totals and frees the entry. */
+void telemetry_leave(telemetry *stats, bool producer) {
+    worker_stats *retired = producer ? &stats->retired_producers : &stats->retired_consumers;
+    worker_stats *self = self_stats;
+    if (!self) {
+        return;
+    }
+    self_stats = NULL;
+
+    stat_move(&retired->messages, &self->messages);
+    stat_move(&retired->bytes, &self->bytes);
+    stat_move(&retired->waits, &self->waits);
+    stat_move(&retired->blocked_ns, &self->blocked_ns);
+    stat_move(&retired->checksum_failures, &self->checksum_failures);
+    for (size_t i = 0; i <= OCCUPANCY_BUCKETS; i++) {
+        stat_move(&retired->occupancy[i], &self->occupancy[i]);
+    }
+    atomic_store(&self->started, 0);
+    atomic_store_explicit(&self->pid, 0, memory_order_release);
+}
+
+/*
+ * Retires the entries of workers that died without telemetry_leave(), so
+ * that their counts stay in the totals and the entries can be reused. The
+ * pid is swapped for -1 first, so two reapers never move an entry twice.
+ */
+void telemetry_reap(telemetry *stats) {
+    for (int side = 0; side < 2; side++) {
+        worker_stats *table = side == 0 ? stats->producers : stats->consumers;
+        worker_stats *retired = side == 0 ? &stats->retired_producers : &stats->retired_consumers;
+
+        for (size_t i = 0; i < TELEMETRY_WORKERS; i++) {
+            worker_stats *entry = &table[i];
+            int pid = atomic_load(&entry->pid);
+            if (pid <= 0 || worker_alive(stats, pid) || !atomic_compare_exchange_strong(&entry->pid, &pid, -1)) {
+                continue;
+            }
+            stat_move(&retired->messages, &entry->messages);
+            stat_move(&retired->bytes, &entry->bytes);
+            stat_move(&retired->waits, &entry->waits);
+            stat_move(&retired->blocked_ns, &entry->blocked_ns);
+            stat_move(&retired->checksum_failures, &entry->checksum_failures);
+            for (size_t bucket = 0; bucket <= OCCUPANCY_BUCKETS; bucket++) {
+                stat_move(&retired->occupancy[bucket], &entry->occupancy[bucket]);
+            }
+            unsigned int orphan = atomic_fetch_add(&stats->orphan_next, 1) % TELEMETRY_ORPHANS;
+            atomic_store(&stats->orphan_intents[orphan], atomic_load(&entry->intent));
+            atomic_store(&entry->started, 0);
+            atomic_store_explicit(&entry->pid, 0, memory_order_release);
+        }
+    }
+}
+
+/* Adds one entry into a snapshot. */
+void telemetry_sum(worker_stats *total, worker_stats *entry) {
+    stat_add(&total->messages, stat_load(&entry->messages));
+    stat_add(&total->bytes, stat_load(&entry->bytes));
+    stat_add(&total->waits, stat_load(&entry->waits));
+    stat_add(&total->blocked_ns, stat_load(&entry->blocked_ns));
+    stat_add(&total->checksum_failures, stat_load(&entry->checksum_failures));
+    for (size_t i = 0; i <= OCCUPANCY_BUCKETS; i++) {
+        stat_add(&total->occupancy[i], stat_load(&entry->occupancy[i]));
+    }
+}
+
+void telemetry_print_entry(FILE *out, const char *name, worker_stats *entry) {
+    fprintf(out, "  %-10s %12" PRIu64 " %12" PRIu64 " %8" PRIu64 " %10.1f %8" PRIu64 "\n",
+            name, stat_load(&entry->messages), stat_load(&entry->bytes), stat_load(&entry->waits),
+            (double)stat_load(&entry->blocked_ns) / 1e6, stat_load(&entry->checksum_failures));
+}
+
+/* Live workers one per line, then the totals including retired ones and their occupancy histogram. */
+void telemetry_print_side(FILE *out, const char *title, worker_stats *table, worker_stats *retired) {
+    worker_stats total;
+    char name[16];
+    memset(&total, 0, sizeof(total));
+
+    fprintf(out, "%s:\n  %-10s %12s %12s %8s %10s %8s\n", title,
+            "pid", "messages", "bytes", "waits", "blocked ms", "bad sum");
+    for (size_t i = 0; i < TELEMETRY_WORKERS; i++) {
+        int pid = atomic_load(&table[i].pid);
+        if (pid > 0) {
+            snprintf(name, sizeof(name), "%d", pid);
+            telemetry_print_entry(out, name, &table[i]);
+            telemetry_sum(&total, &table[i]);
+        }
+    }
+    telemetry_sum(&total, retired);
+    telemetry_print_entry(out, "total", &total);
+
+    uint64_t samples = 0;
+    for (size_t i = 0; i <= OCCUPANCY_BUCKETS; i++) {
+        samples += stat_load(&total.occupancy[i]);
+    }
+    fprintf(out, "  occupancy:");
+    for (size_t i = 0; i <= OCCUPANCY_BUCKETS; i++) {
+        fprintf(out, " %3zu%%:%-5.1f", i * 100 / OCCUPANCY_BUCKETS,
+                samples ? 100.0 * (double)stat_load(&total.occupancy[i]) / (double)samples : 0.0);
+    }
+    fprintf(out, "\n");
+}
+
+#endif // LAB04_TELEMETRY_H
@@ -0,0 +1,201 @@
+#include "producer.h"
+#include "consumer.h"
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_HOST_THREADS TELEMETRY_WORKERS  // every thread needs a telemetry entry
+#define COMMAND_SIZE 64
+
+queue *q;
+_Thread_local volatile sig_atomic_t terminate = 0;
+
+/*
+ * Worker host: many producer and consumer threads in one process, on the
+ * same segment and through the same code as bin/producer and bin/consumer,
+ * so both kinds of workers can share a queue. Threads are added and
+ * removed with commands on stdin (main writes them into a pipe):
+ *
+ *   +p [n]  start n producer threads     -p [n]  stop the n newest
+ *   +c [n]  start n consumer threads     -c [n]  stop the n newest
+ *   l       list the threads             q       stop all and exit
+ *
+ * A thread is stopped with SIGUSR2 sent to it alone; SIGUSR1 stays
+ * process-wide and is blocked in the worker threads, so that kill() from
+ * main reaches the control loop and shuts the whole host down.
+ */
+typedef struct {
+    pthread_t thread;
+    size_t index;
+    atomic_int id;
+} host_worker;
+
+static host_worker producer_threads[MAX_HOST_THREADS];
+static host_worker consumer_threads[MAX_HOST_THREADS];
+static int count_producer_threads = 0;
+static int count_consumer_threads = 0;
+static size_t batch = 1;
+
+void *producer_thread(void *arg) {
+    host_worker *worker = (host_worker *)arg;
+    atomic_store(&worker->id, worker_id());
+    if (!telemetry_join(queue_telemetry(q), true)) {
+        atomic_store(&worker->id, 0);
+        return NULL;
+    }
+
+    run_producer(batch);
+
+    telemetry_leave(queue_telemetry(q), true);
+    atomic_store(&worker->id, 0);
+    return NULL;
+}
+
+/* Homed on shard index % shards and stealing from the others, as main does for consumer processes. */
+void *consumer_thread(void *arg) {
+    host_worker *worker = (host_worker *)arg;
+    uint64_t home = q->shards > 1 ? 1ull << (worker->index % q->shards) : 0;
+    subscription sub;
+
+    atomic_store(&worker->id, worker_id());
+    if (!telemetry_join(queue_telemetry(q), false)) {
+        atomic_store(&worker->id, 0);
+        return NULL;
+    }
+    if (subscribe(&sub, home, q->shards > 1)) {
+        run_consumer(&sub, batch);
+        unsubscribe(&sub);
+    }
+
+    telemetry_leave(queue_telemetry(q), false);
+    atomic_store(&worker->id, 0);
+    return NULL;
+}
+
+/* The new thread starts with SIGUSR1 blocked. */
+bool start_worker(host_worker *worker, size_t index, void *(*run)(void *)) {
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGUSR1);
+
+    worker->index = index;
+    atomic_init(&worker->id, 0);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int err = pthread_create(&worker->thread, NULL, run, worker);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        return false;
+    }
+    return true;
+}
+
+/* A pending SIGUSR2 is delivered once the thread runs, so this works on a thread that has not started yet. */
+void stop_worker(host_worker *worker) {
+    int err = pthread_kill(worker->thread, SIGUSR2);
+    if (err != 0 && err != ESRCH) {
+        fprintf(stderr, "pthread_kill: %s\n", strerror(err));
+    }
+    pthread_join(worker->thread, NULL);
+}
+
+void add_workers(host_worker *table, int *count, int n, void *(*run)(void *)) {
+    for (int i = 0; i < n; i++) {
+        if (*count == MAX_HOST_THREADS) {
+            fprintf(stderr, "HOST: REACHED MAX AMOUNT OF THREADS: %d\n", MAX_HOST_THREADS);
+            return;
+        }
+        if (!start_worker(&table[*count], (size_t)*count, run)) {
+            return;
+        }
+        (*count)++;
+    }
+}
+
+void remove_workers(host_worker *table, int *count, int n) {
+    for (int i = 0; i < n && *count > 0; i++) {
+        stop_worker(&table[--(*count)]);
+    }
+}
+
+void list_workers() {
+    printf("HOST %d: %d producer thread(s), %d consumer thread(s)\n",
+           getpid(), count_producer_threads, count_consumer_threads);
+    for (int i = 0; i < count_producer_threads; i++) {
+        printf("  producer %3d  TID: %d\n", i + 1, atomic_load(&producer_threads[i].id));
+    }
+    for (int i = 0; i < count_consumer_threads; i++) {
+        printf("  consumer %3d  TID: %d\n", i + 1, atomic_load(&consumer_threads[i].id));
+    }
+    fflush(stdout);
+}
+
+/* Runs one control line; false on q. */
+bool run_command(const char *line) {
+    char op, role;
+    int n = 1;
+    int fields = sscanf(line, " %c%c %d", &op, &role, &n);
+
+    if (fields >= 1 && op == 'q') {
+        return false;
+    }
+    if (fields >= 1 && op == 'l') {
+        list_workers();
+        return true;
+    }
+    if (fields < 2 || (op != '+' && op != '-') || (role != 'p' && role != 'c') || n < 1) {
+        fprintf(stderr, "HOST: unknown command: %s", line);
+        return true;
+    }
+
+    host_worker *table = role == 'p' ? producer_threads : consumer_threads;
+    int *count = role == 'p' ? &count_producer_threads : &count_consumer_threads;
+    if (op == '+') {
+        add_workers(table, count, n, role == 'p' ? producer_thread : consumer_thread);
+    } else {
+        remove_workers(table, count, n);
+    }
+    printf("HOST %d: %d producer thread(s), %d consumer thread(s)\n",
+           getpid(), count_producer_threads, count_consumer_threads);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    worker_options options = parse_worker_options(argc, argv);
+    batch = options.batch;
+    initialize();
+
+    struct sigaction sa;
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    if (sigaction(SIGUSR2, &sa, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+
+    srand((unsigned int)time(NULL) ^ getpid());
+    printf("Worker host started (PID: %d), commands: +p|-p|+c|-c [n], l, q\n", getpid());
+    fflush(stdout);
+
+    char line[COMMAND_SIZE];
+    while (!terminate) {
+        if (!fgets(line, sizeof(line), stdin)) {
+            if (ferror(stdin) && errno == EINTR) {
+                clearerr(stdin);
+                continue;
+            }
+            break;
+        }
+        if (!run_command(line)) {
+            break;
+        }
+    }
+
+    remove_workers(producer_threads, &count_producer_threads, count_producer_threads);
+    remove_workers(consumer_threads, &count_consumer_threads, count_consumer_threads);
+    printf("Worker host (PID: %d) terminating\n", getpid());
+    cleanup();
+
+    return 0;
+}
@@ -0,0 +1,516 @@
+#define _POSIX_C_SOURCE 200809L
+#include "queue.h"
+#include "ring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SECONDS 2
+#define DEFAULT_SWEEP "1,2,4,8"
+#define DEFAULT_METHODS "sem,cond,ring"
+#define DEFAULT_queue_SIZE 10
+#define MAX_BENCH_THREADS 64
+#define COND_WAIT_NS 100000000
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BITS)
+
+/*
+ * Non-interactive comparison of the three sync methods: P producers and C
+ * consumers run the same protocol as the menu's routines for a fixed time,
+ * without sleep() and printing. Each producer makes its messages with its
+ * own generator (init_mes_r()) before it goes for the queue, and stamps
+ * the node right before it starts to enqueue it, so the latency the
+ * consumer records covers the same span in all three methods: waiting
+ * for room, enqueueing and the time in the queue.
+ * Per run one CSV line: completed transfers per second, latency
+ * percentiles, and the share of thread time spent acquiring the lock
+ * (sem_wait, pthread_mutex_lock) or blocked on a full or empty queue
+ * (condition variable, ring futex). The semaphore method has no blocking:
+ * where the menu's routine drops the message and sleeps, the bench yields
+ * and retries; the semaphore waits count as lock wait and the rest of the
+ * retry loop as block time. The ring has no lock, so all of its time in
+ * ring_push()/ring_pop() is block time.
+ */
+enum bench_method
+{
+    METHOD_SEM,
+    METHOD_COND,
+    METHOD_RING,
+    METHOD_COUNT
+};
+
+static const char* method_names[METHOD_COUNT] = {"sem", "cond", "ring"};
+
+typedef struct bench_worker
+{
+    pthread_t thread;
+    uint64_t  ops;
+    uint64_t  lock_wait_ns;
+    uint64_t  block_ns;
+    uint64_t  seed;
+    uint64_t  latency[LATENCY_BUCKETS];
+} bench_worker_t;
+
+typedef struct bench_result
+{
+    uint64_t ops;
+    double   seconds;
+    double   ops_per_s;
+    uint64_t p50_ns, p90_ns, p99_ns, p999_ns, max_ns;
+    double   lock_wait_pct;
+    double   block_pct;
+} bench_result_t;
+
+static enum bench_method method;
+static size_t queue_size = DEFAULT_queue_SIZE;
+static atomic_bool running = false;
+static pthread_barrier_t start_line;
+
+static queue_t list;
+static sem_t producer_sem, consumer_sem, mutex_sem;
+static pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+static ring_t* ring;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static size_t latency_bucket(uint64_t ns)
+{
+    if (ns < (1u << LATENCY_SUB_BITS))
+        return (size_t)ns;
+    int exponent = 63 - __builtin_clzll(ns);
+    size_t sub = (size_t)(ns >> (exponent - LATENCY_SUB_BITS)) & ((1u << LATENCY_SUB_BITS) - 1);
+    return ((size_t)(exponent - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+// Lower bound of a bucket, the inverse of latency_bucket().
+static uint64_t latency_bucket_value(size_t bucket)
+{
+    if (bucket < (1u << LATENCY_SUB_BITS))
+        return bucket;
+    int exponent = (int)(bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1u << LATENCY_SUB_BITS) - 1);
+    return ((1ull << LATENCY_SUB_BITS) + sub) << (exponent - LATENCY_SUB_BITS);
+}
+
+static void record_latency(bench_worker_t* worker, uint64_t enqueued_ns)
+{
+    uint64_t now = monotonic_ns();
+    worker->latency[latency_bucket(now > enqueued_ns ? now - enqueued_ns : 0)]++;
+    worker->ops++;
+}
+
+static uint64_t percentile_ns(const uint64_t* histogram, uint64_t total, double p)
+{
+    uint64_t target = (uint64_t)(p * (double)total);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += histogram[bucket];
+        if (seen > target)
+            return latency_bucket_value(bucket);
+    }
+    return 0;
+}
+
+static void sem_acquire(bench_worker_t* worker, sem_t* outer, sem_t* inner)
+{
+    uint64_t start = monotonic_ns();
+    while (sem_wait(outer) != 0 && errno == EINTR);
+    while (sem_wait(inner) != 0 && errno == EINTR);
+    worker->lock_wait_ns += monotonic_ns() - start;
+}
+
+// A failed semaphore round: the queue was full or empty, so yield and charge the retry to block time.
+static void sem_retry(bench_worker_t* worker)
+{
+    uint64_t start = monotonic_ns();
+    sched_yield();
+    worker->block_ns += monotonic_ns() - start;
+}
+
+static void mutex_acquire(bench_worker_t* worker)
+{
+    uint64_t start = monotonic_ns();
+    pthread_mutex_lock(&list_mutex);
+    worker->lock_wait_ns += monotonic_ns() - start;
+}
+
+static void cond_wait(bench_worker_t* worker, pthread_cond_t* cond)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += COND_WAIT_NS;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    uint64_t start = monotonic_ns();
+    pthread_cond_timedwait(cond, &list_mutex, &deadline);
+    worker->block_ns += monotonic_ns() - start;
+}
+
+// One produced message; false once the run is over.
+static bool produce(bench_worker_t* worker)
+{
+    node_t* node = node_create_r(&worker->seed);
+    node->enqueued_ns = monotonic_ns();
+    bool done;
+
+    switch (method)
+    {
+    case METHOD_SEM:
+        for (;;)
+        {
+            sem_acquire(worker, &producer_sem, &mutex_sem);
+            done = list.cur < list.size;
+            if (done)
+            {
+                push_node(&list.head, &list.tail, node);
+                list.added++;
+                list.cur++;
+            }
+            sem_post(&mutex_sem);
+            sem_post(&producer_sem);
+            if (done || !running)
+                break;
+            sem_retry(worker);
+        }
+        break;
+    case METHOD_COND:
+        mutex_acquire(worker);
+        while (list.cur >= list.size && running)
+            cond_wait(worker, &not_full);
+        done = list.cur < list.size;
+        if (done)
+        {
+            push_node(&list.head, &list.tail, node);
+            list.added++;
+            list.cur++;
+            pthread_cond_broadcast(&not_empty);
+        }
+        pthread_mutex_unlock(&list_mutex);
+        break;
+    default:
+    {
+        uint64_t start = monotonic_ns();
+        done = ring_push(ring, node, &running) != 0;
+        worker->block_ns += monotonic_ns() - start;
+        break;
+    }
+    }
+
+    if (!done)
+        node_destroy(node);
+    return done;
+}
+
+// One consumed message, its latency recorded; false once the run is over.
+static bool consume(bench_worker_t* worker)
+{
+    switch (method)
+    {
+    case METHOD_SEM:
+        for (;;)
+        {
+            sem_acquire(worker, &consumer_sem, &mutex_sem);
+            bool done = list.cur > 0;
+            if (done)
+            {
+                record_latency(worker, list.head->enqueued_ns);
+                pop(&list.head, &list.tail);
+                list.deleted++;
+                list.cur--;
+            }
+            sem_post(&mutex_sem);
+            sem_post(&consumer_sem);
+            if (done || !running)
+                return done;
+            sem_retry(worker);
+        }
+    case METHOD_COND:
+    {
+        mutex_acquire(worker);
+        while (list.cur == 0 && running)
+            cond_wait(worker, &not_empty);
+        bool done = list.cur > 0;
+        if (done)
+        {
+            record_latency(worker, list.head->enqueued_ns);
+            pop(&list.head, &list.tail);
+            list.deleted++;
+            list.cur--;
+            pthread_cond_broadcast(&not_full);
+        }
+        pthread_mutex_unlock(&list_mutex);
+        return done;
+    }
+    default:
+    {
+        size_t deleted;
+        uint64_t start = monotonic_ns();
+        node_t* node = ring_pop(ring, &running, &deleted);
+        worker->block_ns += monotonic_ns() - start;
+        if (!node)
+            return false;
+        record_latency(worker, node->enqueued_ns);
+        node_destroy(node);
+        return true;
+    }
+    }
+}
+
+static void* producer_main(void* arg)
+{
+    bench_worker_t* worker = (bench_worker_t*)arg;
+    pthread_barrier_wait(&start_line);
+    while (running && produce(worker));
+    queue_pool_flush();
+    return NULL;
+}
+
+static void* consumer_main(void* arg)
+{
+    bench_worker_t* worker = (bench_worker_t*)arg;
+    pthread_barrier_wait(&start_line);
+    while (running && consume(worker));
+    queue_pool_flush();
+    return NULL;
+}
+
+static void setup(void)
+{
+    memset(&list, 0, sizeof(list));
+    list.size = queue_size;
+    switch (method)
+    {
+    case METHOD_SEM:
+        // Unnamed, so that a running bin/main keeps its named ones
+        sem_init(&producer_sem, 0, 1);
+        sem_init(&consumer_sem, 0, 1);
+        sem_init(&mutex_sem, 0, 1);
+        break;
+    case METHOD_COND:
+        break;
+    default:
+        ring = ring_create(RING_CAPACITY, queue_size);
+        break;
+    }
+}
+
+static void teardown(void)
+{
+    switch (method)
+    {
+    case METHOD_SEM:
+        sem_destroy(&producer_sem);
+        sem_destroy(&consumer_sem);
+        sem_destroy(&mutex_sem);
+        break;
+    case METHOD_COND:
+        break;
+    default:
+        ring_destroy(ring);
+        ring = NULL;
+        break;
+    }
+    queue_clear(&list);
+}
+
+static bench_result_t run(size_t producers, size_t consumers, double seconds)
+{
+    static bench_worker_t workers[2 * MAX_BENCH_THREADS];
+    static uint64_t histogram[LATENCY_BUCKETS];
+    size_t threads = producers + consumers;
+    bench_result_t result;
+
+    memset(workers, 0, sizeof(workers));
+    memset(histogram, 0, sizeof(histogram));
+    memset(&result, 0, sizeof(result));
+    setup();
+    pthread_barrier_init(&start_line, NULL, (unsigned int)threads + 1);
+    running = true;
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers[i].seed = 0x9E3779B97F4A7C15ull * (i + 1);  // distinct and never 0
+        int err = pthread_create(&workers[i].thread, NULL, i < producers ? producer_main : consumer_main, &workers[i]);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(&start_line);
+    uint64_t start = monotonic_ns();
+    struct timespec duration = {(time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9)};
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR);
+    running = false;
+    uint64_t elapsed = monotonic_ns() - start;
+
+    pthread_mutex_lock(&list_mutex);
+    pthread_cond_broadcast(&not_empty);
+    pthread_cond_broadcast(&not_full);
+    pthread_mutex_unlock(&list_mutex);
+    for (size_t i = 0; i < threads; i++)
+        pthread_join(workers[i].thread, NULL);
+    // Sleepers only notice the stop after their bounded wait, so they are charged up to here
+    uint64_t thread_time = (monotonic_ns() - start) * threads;
+    pthread_barrier_destroy(&start_line);
+    teardown();
+
+    uint64_t lock_wait = 0, block = 0;
+    for (size_t i = 0; i < threads; i++)
+    {
+        lock_wait += workers[i].lock_wait_ns;
+        block += workers[i].block_ns;
+        if (i < producers)
+            continue;
+        result.ops += workers[i].ops;
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+            histogram[bucket] += workers[i].latency[bucket];
+    }
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+        if (histogram[bucket])
+            result.max_ns = latency_bucket_value(bucket);
+
+    result.seconds = (double)elapsed / 1e9;
+    result.ops_per_s = (double)result.ops / result.seconds;
+    result.p50_ns = percentile_ns(histogram, result.ops, 0.50);
+    result.p90_ns = percentile_ns(histogram, result.ops, 0.90);
+    result.p99_ns = percentile_ns(histogram, result.ops, 0.99);
+    result.p999_ns = percentile_ns(histogram, result.ops, 0.999);
+    result.lock_wait_pct = 100.0 * (double)lock_wait / (double)thread_time;
+    result.block_pct = 100.0 * (double)block / (double)thread_time;
+    return result;
+}
+
+// "n" runs n producers and n consumers, "PxC" P producers and C consumers.
+static bool parse_threads(const char* token, size_t* producers, size_t* consumers)
+{
+    char* end;
+    unsigned long p = strtoul(token, &end, 10);
+    unsigned long c = p;
+    if (*end == 'x')
+        c = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || p == 0 || c == 0 || p > MAX_BENCH_THREADS || c > MAX_BENCH_THREADS)
+        return false;
+    *producers = p;
+    *consumers = c;
+    return true;
+}
+
+static int parse_method(const char* name)
+{
+    for (int m = 0; m < METHOD_COUNT; m++)
+        if (strcmp(name, method_names[m]) == 0)
+            return m;
+    return -1;
+}
+
+void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [-t seconds] [-n threads,...] [-m sem,cond,ring] [-s queue_size] [-o results.csv]\n", program);
+    fprintf(stderr, "  -t  seconds per run (default %d)\n", DEFAULT_SECONDS);
+    fprintf(stderr, "  -n  thread counts to sweep: n for n producers + n consumers, or PxC (default %s)\n", DEFAULT_SWEEP);
+    fprintf(stderr, "  -m  methods to compare (default %s)\n", DEFAULT_METHODS);
+    fprintf(stderr, "  -s  queue size limit (default %d)\n", DEFAULT_queue_SIZE);
+    fprintf(stderr, "  -o  CSV file instead of stdout\n");
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = DEFAULT_SECONDS;
+    char sweep[256] = DEFAULT_SWEEP;
+    char methods[64] = DEFAULT_METHODS;
+    const char* path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:n:m:s:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': seconds = strtod(optarg, NULL); break;
+        case 'n': snprintf(sweep, sizeof(sweep), "%s", optarg); break;
+        case 'm': snprintf(methods, sizeof(methods), "%s", optarg); break;
+        case 's': queue_size = strtoul(optarg, NULL, 10); break;
+        case 'o': path = optarg; break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (seconds <= 0 || queue_size == 0 || queue_size > RING_CAPACITY)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t producers[32], consumers[32], runs = 0;
+    char* save;
+    for (char* token = strtok_r(sweep, ",", &save); token; token = strtok_r(NULL, ",", &save))
+    {
+        if (runs == 32 || !parse_threads(token, &producers[runs], &consumers[runs])) {
+            fprintf(stderr, "bad thread count: %s\n", token);
+            return EXIT_FAILURE;
+        }
+        runs++;
+    }
+    int selected[METHOD_COUNT], method_count = 0;
+    for (char* token = strtok_r(methods, ",", &save); token; token = strtok_r(NULL, ",", &save))
+    {
+        int m = parse_method(token);
+        if (m == -1 || method_count == METHOD_COUNT) {
+            fprintf(stderr, "unknown method: %s\n", token);
+            return EXIT_FAILURE;
+        }
+        selected[method_count++] = m;
+    }
+
+    FILE* out = path ? fopen(path, "w") : stdout;
+    if (!out) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "method,producers,consumers,queue_size,seconds,ops,ops_per_s,"
+                 "p50_ns,p90_ns,p99_ns,p999_ns,max_ns,lock_wait_pct,block_pct\n");
+
+    for (size_t r = 0; r < runs; r++)
+    {
+        for (int m = 0; m < method_count; m++)
+        {
+            method = (enum bench_method)selected[m];
+            bench_result_t result = run(producers[r], consumers[r], seconds);
+            fprintf(out, "%s,%zu,%zu,%zu,%.3f,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,%.2f,%.2f\n",
+                    method_names[method], producers[r], consumers[r], queue_size, result.seconds,
+                    (unsigned long long)result.ops, result.ops_per_s,
+                    (unsigned long long)result.p50_ns, (unsigned long long)result.p90_ns,
+                    (unsigned long long)result.p99_ns, (unsigned long long)result.p999_ns,
+                    (unsigned long long)result.max_ns, result.lock_wait_pct, result.block_pct);
+            fflush(out);
+            if (path)
+                fprintf(stderr, "%-4s %2zux%-2zu %12.0f ops/s  p99 %llu ns\n", method_names[method],
+                        producers[r], consumers[r], result.ops_per_s, (unsigned long long)result.p99_ns);
+        }
+    }
+
+    if (path)
+        fclose(out);
+    queue_pool_destroy();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include "crc16.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_CRC16_CLMUL 1
+#endif
+
+// Below this the table wins: PCLMULQDQ setup and the final byte-wise reduction cost more than the lookups.
+#define CRC16_CLMUL_MIN 64
+
+/*
+ * crc16_table[k][b] is the CRC (from 0) of byte b followed by k zero
+ * bytes, so eight bytes fold into the register with eight lookups.
+ */
+static uint16_t crc16_table[8][256];
+static bool use_clmul = false;
+static pthread_once_t crc16_once = PTHREAD_ONCE_INIT;
+
+static void crc16_init(void)
+{
+    for (int b = 0; b < 256; b++)
+    {
+        uint16_t crc = (uint16_t)(b << 8);
+        for (int j = 0; j < 8; j++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ CRC16_POLY) : (uint16_t)(crc << 1);
+        crc16_table[0][b] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            uint16_t prev = crc16_table[k - 1][b];
+            crc16_table[k][b] = (uint16_t)((prev << 8) ^ crc16_table[0][prev >> 8]);
+        }
+    }
+
+#ifdef HAVE_CRC16_CLMUL
+    __builtin_cpu_init();
+    use_clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// Original bit-by-bit version, kept as the reference the others are checked against.
+uint16_t crc16_bitwise(const uint8_t *data, size_t length)
+{
+    uint16_t crc = CRC16_INIT;
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int j = 0; j < 8; ++j)
+        {
+            if (crc & 0x8000)
+                crc = (crc << 1) ^ CRC16_POLY;
+            else
+                crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t length)
+{
+    while (length >= 8)
+    {
+        crc = crc16_table[7][data[0] ^ (crc >> 8)] ^ crc16_table[6][data[1] ^ (crc & 0xFF)] ^
+              crc16_table[5][data[2]] ^ crc16_table[4][data[3]] ^
+              crc16_table[3][data[4]] ^ crc16_table[2][data[5]] ^
+              crc16_table[1][data[6]] ^ crc16_table[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0)
+        crc = (uint16_t)((crc << 8) ^ crc16_table[0][(crc >> 8) ^ *data++]);
+    return crc;
+}
+
+uint16_t crc16_slice8(const uint8_t* data, size_t length)
+{
+    pthread_once(&crc16_once, crc16_init);
+    return crc16_update(CRC16_INIT, data, length);
+}
+
+#ifdef HAVE_CRC16_CLMUL
+/*
+ * Carry-less multiply folding. A 16-byte block, byte-swapped, is a
+ * polynomial of degree < 128 with the first message bit on top. Moving it
+ * n bits further down the message multiplies it by x^n, which modulo the
+ * CRC polynomial is a 16-bit constant, so each 64-bit half costs one
+ * PCLMULQDQ and the folded value stays congruent to the message so far.
+ * The last 128 bits go through the table, which does the final reduction.
+ * Constants are x^n mod 0x11021:
+ */
+#define CRC16_X128 0xAEFC    // fold by one block, low half
+#define CRC16_X192 0x650B    // fold by one block, high half
+#define CRC16_X512 0x13FC    // fold by four blocks, low half
+#define CRC16_X576 0x8832    // fold by four blocks, high half
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i load_be(const uint8_t* data)
+{
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), reverse);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i fold(__m128i x, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint16_t crc16_clmul_run(const uint8_t* data, size_t length)
+{
+    const __m128i by1 = _mm_set_epi64x(CRC16_X192, CRC16_X128);
+    // The initial value is the same as XOR into the first 16 message bits.
+    __m128i x0 = _mm_xor_si128(load_be(data), _mm_set_epi64x((long long)((uint64_t)CRC16_INIT << 48), 0));
+    data += 16;
+    length -= 16;
+
+    if (length >= 48)
+    {
+        const __m128i by4 = _mm_set_epi64x(CRC16_X576, CRC16_X512);
+        __m128i x1 = load_be(data);
+        __m128i x2 = load_be(data + 16);
+        __m128i x3 = load_be(data + 32);
+        data += 48;
+        length -= 48;
+
+        while (length >= 64)
+        {
+            x0 = _mm_xor_si128(fold(x0, by4), load_be(data));
+            x1 = _mm_xor_si128(fold(x1, by4), load_be(data + 16));
+            x2 = _mm_xor_si128(fold(x2, by4), load_be(data + 32));
+            x3 = _mm_xor_si128(fold(x3, by4), load_be(data + 48));
+            data += 64;
+            length -= 64;
+        }
+        x0 = _mm_xor_si128(fold(x0, by1), x1);
+        x0 = _mm_xor_si128(fold(x0, by1), x2);
+        x0 = _mm_xor_si128(fold(x0, by1), x3);
+    }
+
+    while (length >= 16)
+    {
+        x0 = _mm_xor_si128(fold(x0, by1), load_be(data));
+        data += 16;
+        length -= 16;
+    }
+
+    uint8_t folded[16];
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    _mm_storeu_si128((__m128i*)folded, _mm_shuffle_epi8(x0, reverse));
+    return crc16_update(crc16_update(0, folded, sizeof(folded)), data, length);
+}
+#endif
+
+bool crc16_clmul_available(void)
+{
+    pthread_once(&crc16_once, crc16_init);
+    return use_clmul;
+}
+
+// Needs crc16_clmul_available(); short inputs are left to the table.
+uint16_t crc16_clmul(const uint8_t* data, size_t length)
+{
+#ifdef HAVE_CRC16_CLMUL
+    if (length >= CRC16_CLMUL_MIN && crc16_clmul_available())
+        return crc16_clmul_run(data, length);
+#endif
+    return crc16_slice8(data, length);
+}
+
+uint16_t crc16(const uint8_t* data, size_t length)
+{
+    return crc16_clmul_available() ? crc16_clmul(data, length) : crc16_slice8(data, length);
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// CRC16-CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, no reflection, no final XOR.
+#define CRC16_POLY 0x1021
+#define CRC16_INIT 0xFFFF
+
+uint16_t crc16(const uint8_t*, size_t);
+uint16_t crc16_bitwise(const uint8_t*, size_t);
+uint16_t crc16_slice8(const uint8_t*, size_t);
+uint16_t crc16_clmul(const uint8_t*, size_t);
+bool     crc16_clmul_available(void);
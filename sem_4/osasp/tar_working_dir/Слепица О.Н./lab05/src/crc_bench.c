@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 199309L
+#include "crc16.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ROUNDS 200000
+#define DEFAULT_FUZZ_CASES 100000
+#define FUZZ_MAX_LENGTH 4096
+#define CHECK_STRING "123456789"
+#define CHECK_CRC16 0x29B1
+
+typedef uint16_t (*crc_fn)(const uint8_t*, size_t);
+
+double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Average ns per call over 64 buffers of the same length.
+double time_crc(crc_fn fn, const uint8_t* buffers, size_t length, long rounds)
+{
+    volatile uint16_t sink = 0;
+    double start = now_ns();
+
+    for (long i = 0; i < rounds; i++)
+        sink ^= fn(buffers + (size_t)(i & 63) * FUZZ_MAX_LENGTH, length);
+    (void)sink;
+    return (now_ns() - start) / (double)rounds;
+}
+
+/*
+ * Random lengths (0..FUZZ_MAX_LENGTH) at random offsets, all variants
+ * against the bitwise reference. Returns the number of mismatches.
+ */
+long fuzz(long cases)
+{
+    static uint8_t buffer[FUZZ_MAX_LENGTH + 16];
+    bool clmul = crc16_clmul_available();
+    long mismatches = 0;
+
+    for (long c = 0; c < cases; c++)
+    {
+        size_t length = (size_t)rand() % (FUZZ_MAX_LENGTH + 1);
+        if (c % 4 == 0)
+            length %= 129;  // short inputs are where the variants switch over
+        size_t offset = (size_t)rand() % 16;
+        for (size_t i = 0; i < length; i++)
+            buffer[offset + i] = (uint8_t)rand();
+
+        uint16_t expected = crc16_bitwise(buffer + offset, length);
+        uint16_t slice8 = crc16_slice8(buffer + offset, length);
+        uint16_t hw = clmul ? crc16_clmul(buffer + offset, length) : expected;
+        uint16_t dispatched = crc16(buffer + offset, length);
+
+        if (slice8 != expected || hw != expected || dispatched != expected)
+        {
+            if (mismatches++ < 10)
+                fprintf(stderr, "MISMATCH: length %zu offset %zu: bitwise %04x slice8 %04x clmul %04x crc16 %04x\n",
+                        length, offset, expected, slice8, hw, dispatched);
+        }
+    }
+    return mismatches;
+}
+
+void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [-r rounds_per_size] [-f fuzz_cases]\n", program);
+    fprintf(stderr, "  -r  timed calls per variant and size (default %d)\n", DEFAULT_ROUNDS);
+    fprintf(stderr, "  -f  only compare all variants on that many random inputs\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const size_t sizes[] = {8, 32, 48, 64, 96, 128, 256, 1024, 4096};
+    static uint8_t buffers[64 * FUZZ_MAX_LENGTH];
+    long rounds = DEFAULT_ROUNDS;
+    long fuzz_cases = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r': rounds = strtol(optarg, NULL, 10); break;
+        case 'f': fuzz_cases = strtol(optarg, NULL, 10); break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (rounds <= 0 || fuzz_cases < 0)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+    const uint8_t* check = (const uint8_t*)CHECK_STRING;
+    if (crc16_bitwise(check, strlen(CHECK_STRING)) != CHECK_CRC16 ||
+        crc16_slice8(check, strlen(CHECK_STRING)) != CHECK_CRC16 ||
+        crc16(check, strlen(CHECK_STRING)) != CHECK_CRC16)
+    {
+        fprintf(stderr, "crc16 check value mismatch\n");
+        return EXIT_FAILURE;
+    }
+
+    bool clmul = crc16_clmul_available();
+    long mismatches = fuzz(fuzz_cases > 0 ? fuzz_cases : DEFAULT_FUZZ_CASES / 10);
+    if (fuzz_cases > 0 || mismatches > 0)
+    {
+        printf("%ld random inputs, PCLMULQDQ: %s, mismatches: %ld\n",
+               fuzz_cases > 0 ? fuzz_cases : DEFAULT_FUZZ_CASES / 10, clmul ? "yes" : "no", mismatches);
+        return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(buffers); i++)
+        buffers[i] = (uint8_t)rand();
+
+    printf("Rounds per size: %ld, PCLMULQDQ: %s\n", rounds, clmul ? "yes" : "no");
+    printf("%8s %12s %12s %12s %10s\n", "bytes", "bitwise ns", "slice8 ns", "clmul ns", "best gain");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        long n = sizes[s] > 256 ? rounds / 8 : rounds;
+        double bitwise = time_crc(crc16_bitwise, buffers, sizes[s], n);
+        double slice8 = time_crc(crc16_slice8, buffers, sizes[s], n);
+        double best = slice8;
+
+        printf("%8zu %12.1f %12.1f", sizes[s], bitwise, slice8);
+        if (clmul)
+        {
+            double hw = time_crc(crc16_clmul, buffers, sizes[s], n);
+            best = hw < best ? hw : best;
+            printf(" %12.1f", hw);
+        }
+        else
+        {
+            printf(" %12s", "-");
+        }
+        printf(" %9.1fx\n", bitwise / best);
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include "queue.h"
+#include "ring.h"
 #include "utils.h"
 
 #include <unistd.h>
@@ -21,7 +22,8 @@ volatile sig_atomic_t stop_flag = 0;
 #define MAX_THREADS_COUNT 50
 
 queue_t* queue;
-int sync_method = 0; // 0 - semaphores, 1 - condvars
+int sync_method = 0; // 0 - semaphores, 1 - condvars, 2 - lock-free ring
+ring_t* ring = NULL;
 
 
 sem_t* producer;
@@ -48,9 +50,10 @@ int main()
     printf("Select synchronization method:\n");
     printf("1 - Semaphores and mutex\n");
     printf("2 - Conditional variables\n");
+    printf("3 - Lock-free ring (no lock, futex only when full or empty)\n");
     printf("Your choice: ");
     scanf("%d", &sync_method);
-    sync_method--; // 0 or 1
+    sync_method--; // 0, 1 or 2
 
     initialize_sync_primitives();
 
@@ -77,7 +80,8 @@ int main()
     queue->added = 0;
     queue->deleted = 0;
 
-    printf("Using %s\n", sync_method == 0 ? "POSIX semaphores" : "conditional variables");
+    printf("Using %s\n", sync_method == 0 ? "POSIX semaphores" :
+                          sync_method == 1 ? "conditional variables" : "lock-free ring");
     display_main_menu();
     printf("\nCurrent queue size: %ld\n", queue->size);
 
@@ -93,7 +97,8 @@ int main()
                 printf("Max producer threads reached.\n");
                 break;
             }
-            void* (*routine)(void*) = sync_method == 0 ? producer_routine : producer_routine_cond;
+            void* (*routine)(void*) = sync_method == 0 ? producer_routine :
+                                      sync_method == 1 ? producer_routine_cond : producer_routine_ring;
             pthread_create(&producer_threads[producer_threads_count++], NULL, routine, NULL);
             producer_count++;
             break;
@@ -119,7 +124,8 @@ int main()
                 printf("Max consumer threads reached.\n");
                 break;
             }
-            void* (*routine)(void*) = sync_method == 0 ? consumer_routine : consumer_routine_cond;
+            void* (*routine)(void*) = sync_method == 0 ? consumer_routine :
+                                      sync_method == 1 ? consumer_routine_cond : consumer_routine_ring;
             pthread_create(&consumer_threads[consumer_threads_count++], NULL, routine, NULL);
             consumer_count++;
             break;
@@ -141,6 +147,17 @@ int main()
         } 
         case 'l':
         {
+            if (sync_method == 2) {
+                // Counters of the ring are atomics, nothing to lock
+                printf("ADDED: %ld\nGOT: %ld\nProducers COUNT: %ld\nConsumers COUNT: %ld\nCurrent SIZE: %ld\nMax size: %ld\n", 
+                    atomic_load(&ring->added), 
+                    atomic_load(&ring->deleted), 
+                    producer_count, 
+                    consumer_count,
+                    ring_length(ring),
+                    queue->size);
+                break;
+            }
             if (sync_method == 0) {
                 sem_wait(mutex);
             } else {
@@ -164,7 +181,12 @@ int main()
         }
         case '+':
         {
-            if (sync_method == 0) {
+            if (sync_method == 2) {
+                if (queue->size < ring->capacity) {
+                    queue->size++;
+                    ring_set_limit(ring, queue->size);
+                }
+            } else if (sync_method == 0) {
                 sem_wait(mutex);
                 queue->size++;
                 sem_post(mutex);
@@ -179,7 +201,14 @@ int main()
         
         case '-':
         {
-            if (sync_method == 0) {
+            if (sync_method == 2) {
+                if (queue->size > 0) {
+                    queue->size--;
+                    shrink_ring(queue->size);
+                } else {
+                    printf("\nQueue is empty\n");
+                }
+            } else if (sync_method == 0) {
                 sem_wait(mutex);
                 if (queue->size > 0) {
                     queue->size--;
@@ -275,6 +304,7 @@ void graceful_shutdown(
 
     queue_clear(queue);
     free(queue);
+    queue_pool_destroy();
 
     printf("\nGraceful shutdown complete.\n");
 }
@@ -288,6 +318,8 @@ void initialize_sync_primitives() {
         producer = sem_open("/producer", O_CREAT, 0644, 1);
         consumer = sem_open("/consumer", O_CREAT, 0644, 1);
         mutex = sem_open("/mutex", O_CREAT, 0644, 1);
+    } else if (sync_method == 2) {
+        ring = ring_create(RING_CAPACITY, DEFAULT_queue_SIZE);
     } else {
         pthread_mutex_init(&queue_mutex, NULL);
         pthread_cond_init(&not_empty, NULL);
@@ -304,6 +336,9 @@ void cleanup_sync_primitives() {
         sem_unlink("/producer");
         sem_unlink("/consumer");
         sem_unlink("/mutex");
+    } else if (sync_method == 2) {
+        ring_destroy(ring);
+        ring = NULL;
     } else {
         pthread_mutex_destroy(&queue_mutex);
         pthread_cond_destroy(&not_empty);
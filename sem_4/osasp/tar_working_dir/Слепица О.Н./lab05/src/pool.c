@@ -0,0 +1,190 @@
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+// One cache per thread, bound to the first pool the thread uses; any other pool goes to its shared list directly.
+typedef struct pool_cache
+{
+    pool_t*        pool;
+    pool_object_t* head;
+    size_t         count;
+} pool_cache_t;
+
+static _Thread_local pool_cache_t cache;
+
+static size_t pool_stride(const pool_t* pool)
+{
+    size_t align = alignof(max_align_t);
+    size_t size = pool->object_size < sizeof(pool_object_t) ? sizeof(pool_object_t) : pool->object_size;
+    return (size + align - 1) & ~(align - 1);
+}
+
+static size_t slab_header_size(void)
+{
+    size_t align = alignof(max_align_t);
+    return (sizeof(pool_slab_t) + align - 1) & ~(align - 1);
+}
+
+static pool_cache_t* pool_cache(pool_t* pool)
+{
+    if (cache.pool == NULL)
+        cache.pool = pool;
+    return cache.pool == pool ? &cache : NULL;
+}
+
+// Links a new slab into the pool and returns its objects as a list. Called with the lock held.
+static pool_object_t* pool_grow(pool_t* pool, size_t* count)
+{
+    size_t stride = pool_stride(pool);
+    pool_slab_t* slab = (pool_slab_t*)malloc(slab_header_size() + POOL_SLAB_OBJECTS * stride);
+    if (!slab) {
+        perror("Failed to allocate pool slab");
+        exit(EXIT_FAILURE);
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    char* first = (char*)slab + slab_header_size();
+    for (size_t i = 0; i < POOL_SLAB_OBJECTS; i++)
+    {
+        pool_object_t* object = (pool_object_t*)(first + i * stride);
+        object->next = i + 1 < POOL_SLAB_OBJECTS ? (pool_object_t*)(first + (i + 1) * stride) : NULL;
+    }
+    *count = POOL_SLAB_OBJECTS;
+    return (pool_object_t*)first;
+}
+
+// Takes up to POOL_BATCH objects off the shared list, or a fresh slab when it is empty.
+static pool_object_t* pool_take_batch(pool_t* pool, size_t* count)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    pool_object_t* batch = pool->free_list;
+    if (batch == NULL)
+    {
+        batch = pool_grow(pool, count);
+    }
+    else
+    {
+        pool_object_t* last = batch;
+        *count = 1;
+        while (*count < POOL_BATCH && last->next != NULL)
+        {
+            last = last->next;
+            (*count)++;
+        }
+        pool->free_list = last->next;
+        last->next = NULL;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return batch;
+}
+
+static void pool_give_back(pool_t* pool, pool_object_t* first, pool_object_t* last)
+{
+    pthread_mutex_lock(&pool->lock);
+    last->next = pool->free_list;
+    pool->free_list = first;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void* pool_alloc(pool_t* pool)
+{
+    pool_cache_t* own = pool_cache(pool);
+    size_t count;
+
+    if (own == NULL)
+    {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->free_list == NULL)
+            pool->free_list = pool_grow(pool, &count);
+        pool_object_t* object = pool->free_list;
+        pool->free_list = object->next;
+        pthread_mutex_unlock(&pool->lock);
+        return object;
+    }
+
+    if (own->head == NULL)
+    {
+        own->head = pool_take_batch(pool, &count);
+        own->count = count;
+    }
+    pool_object_t* object = own->head;
+    own->head = object->next;
+    own->count--;
+    return object;
+}
+
+/*
+ * Consumers free what producers allocated, so a consumer's cache keeps
+ * growing: past 2 * POOL_BATCH, one batch goes back to the shared list.
+ */
+void pool_free(pool_t* pool, void* ptr)
+{
+    pool_object_t* object = (pool_object_t*)ptr;
+    pool_cache_t* own = pool_cache(pool);
+
+    if (own == NULL)
+    {
+        pool_give_back(pool, object, object);
+        return;
+    }
+
+    object->next = own->head;
+    own->head = object;
+    if (++own->count < 2 * POOL_BATCH)
+        return;
+
+    pool_object_t* last = own->head;
+    for (size_t i = 1; i < POOL_BATCH; i++)
+        last = last->next;
+    pool_object_t* first = own->head;
+    own->head = last->next;
+    own->count -= POOL_BATCH;
+    pool_give_back(pool, first, last);
+}
+
+// Returns the calling thread's cache to the shared list; threads call it before they exit.
+void pool_thread_flush(pool_t* pool)
+{
+    if (cache.pool != pool)
+        return;
+
+    if (cache.head != NULL)
+    {
+        pool_object_t* last = cache.head;
+        while (last->next != NULL)
+            last = last->next;
+        pool_give_back(pool, cache.head, last);
+    }
+    cache.pool = NULL;
+    cache.head = NULL;
+    cache.count = 0;
+}
+
+// Frees every slab; all objects must be back (other threads joined and flushed).
+void pool_destroy(pool_t* pool)
+{
+    if (cache.pool == pool)
+    {
+        cache.pool = NULL;
+        cache.head = NULL;
+        cache.count = 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->slabs != NULL)
+    {
+        pool_slab_t* slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
+    }
+    pool->free_list = NULL;
+    pool->slab_count = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <pthread.h>
+
+#define POOL_SLAB_OBJECTS 64   // objects carved out of one malloc'ed slab
+#define POOL_BATCH 32          // objects moved between a thread cache and the shared list at once
+
+/*
+ * Fixed-size object pool. Objects come from slabs that are only freed by
+ * pool_destroy(); freed objects go to the calling thread's cache, and only
+ * whole batches of POOL_BATCH travel through the shared free list under
+ * the pool lock. Once the pool has grown to the working set, alloc and
+ * free stay off the general-purpose allocator entirely.
+ */
+typedef struct pool_object
+{
+    struct pool_object* next;
+} pool_object_t;
+
+typedef struct pool_slab
+{
+    struct pool_slab* next;
+} pool_slab_t;
+
+typedef struct pool
+{
+    size_t          object_size;
+    pthread_mutex_t lock;
+    pool_object_t*  free_list;
+    pool_slab_t*    slabs;
+    size_t          slab_count;
+} pool_t;
+
+#define POOL_INITIALIZER(size) { (size), PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0 }
+
+void* pool_alloc(pool_t*);
+void  pool_free(pool_t*, void*);
+void  pool_thread_flush(pool_t*);
+void  pool_destroy(pool_t*);
@@ -1,26 +1,85 @@
 #include "queue.h"
+#include "pool.h"
+#include "crc16.h"
+
+#define NODE_OBJECT_SIZE (sizeof(node_t) + sizeof(mes_t) + MES_DATA_MAX)
+
+static pool_t node_pool = POOL_INITIALIZER(NODE_OBJECT_SIZE);
+
+static node_t* node_alloc(void)
+{
+    node_t* node = (node_t*)pool_alloc(&node_pool);
+    node->message = (mes_t*)(node + 1);
+    return node;
+}
+
+static void node_free(node_t* node)
+{
+    pool_free(&node_pool, node);
+}
+
+static node_t* node_detached(node_t* node)
+{
+    node->next = NULL;
+    node->prev = NULL;
+    node->enqueued_ns = 0;
+    return node;
+}
+
+// A detached node with a fresh message, for queues that do not link nodes (ring.c).
+node_t* node_create(void)
+{
+    node_t* node = node_alloc();
+    init_mes(node->message);
+    return node_detached(node);
+}
+
+// node_create() with the message drawn from the caller's generator, see init_mes_r().
+node_t* node_create_r(uint64_t* seed)
+{
+    node_t* node = node_alloc();
+    init_mes_r(node->message, seed);
+    return node_detached(node);
+}
+
+void node_destroy(node_t* node)
+{
+    node_free(node);
+}
+
+// Threads that pushed or popped call this before they exit, so their cached nodes can be reused.
+void queue_pool_flush(void)
+{
+    pool_thread_flush(&node_pool);
+}
+
+void queue_pool_destroy(void)
+{
+    pool_destroy(&node_pool);
+}
 
 void push(node_t** head, node_t** tail) 
+{
+    push_node(head, tail, node_create());
+}
+
+// Links a node made by node_create() or node_create_r() in at the tail.
+void push_node(node_t** head, node_t** tail, node_t* node)
 {
     if (*head != NULL) 
     {
-        node_t *temp = (node_t*)malloc(sizeof(node_t));
-        temp->message = (mes_t*)malloc(sizeof(mes_t));
-        init_mes(temp->message);
-        temp->next = *head;
-        temp->prev = *tail;
-        (*tail)->next = temp;
-        (*head)->prev = temp;
-        *tail = temp;
+        node->next = *head;
+        node->prev = *tail;
+        (*tail)->next = node;
+        (*head)->prev = node;
+        *tail = node;
     } 
     else 
     {
-        *head = (node_t*)malloc(sizeof(node_t));
-        (*head)->message = (mes_t*)malloc(sizeof(mes_t));
-        init_mes((*head)->message);
-        (*head)->prev = *head;
-        (*head)->next = *head;
-        *tail = *head;
+        *head = node;
+        node->prev = node;
+        node->next = node;
+        *tail = node;
     }
 }
 
@@ -35,55 +94,49 @@ void pop(node_t** head, node_t** tail)
             *head = (*head)->next;
             (*head)->prev = *tail;
 
-            if (temp->message != NULL) {
-                free(temp->message->data);  
-                free(temp->message);      
-            }
-
-            free(temp);  
+            node_free(temp);
         } 
         else 
         {
-            if (*head != NULL && (*head)->message != NULL) {
-                free((*head)->message->data);  
-                free((*head)->message);        
-            }
-            free(*head); 
+            node_free(*head);
             *head = NULL;
             *tail = NULL;
         }
     }
 }
 
-uint16_t crc16(const uint8_t *data, size_t length) 
+// Next number from *seed (xorshift64*), or from rand() when there is no seed.
+static unsigned int mes_random(uint64_t* seed)
 {
-    uint16_t crc = 0xFFFF;  // Initial value
-    for (size_t i = 0; i < length; ++i) 
-    {
-        crc ^= (uint16_t)data[i] << 8;
-        for (int j = 0; j < 8; ++j) 
-        {
-            if (crc & 0x8000)
-                crc = (crc << 1) ^ 0x1021; 
-            else
-                crc <<= 1;
-        }
-    }
-    return crc;
+    if (seed == NULL)
+        return (unsigned int)rand();
+
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return (unsigned int)((*seed * 0x2545F4914F6CDD1Dull) >> 33);
 }
 
 void init_mes(mes_t* message) 
+{
+    init_mes_r(message, NULL);
+}
+
+/*
+ * init_mes() on the caller's own generator state (nonzero), so threads
+ * that make messages in parallel do not serialize on rand()'s lock.
+ */
+void init_mes_r(mes_t* message, uint64_t* seed)
 {
     const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
     message->type = 0;
-    message->size = rand() % 257;
-    message->data = (uint8_t*)malloc(message->size * sizeof(uint8_t));
+    message->size = mes_random(seed) % 257;
     
     // Заполняем массив данных случайными символами
     for (size_t i = 0; i < message->size; i++) 
     {
-        message->data[i] = letters[rand() % (sizeof(letters) - 1)];
+        message->data[i] = letters[mes_random(seed) % (sizeof(letters) - 1)];
     }
     
     message->hash = crc16(message->data, message->size);
@@ -116,12 +169,8 @@ void queue_clear(queue_t* queue) {
         node_t* temp = current;
         current = current->next;
 
-        if (temp->message) {
-            mes_clear(temp->message);
-            free(temp->message);
-        }
-
-        free(temp);
+        mes_clear(temp->message);
+        node_free(temp);
     } while (current != queue->head); 
 
     queue->head = NULL;
@@ -136,11 +185,6 @@ void queue_clear(queue_t* queue) {
 void mes_clear(mes_t* msg) {
     if (!msg) return;
     
-    if (msg->data) {
-        free(msg->data);
-        msg->data = NULL;
-    }
-    
     msg->type = 0;
     msg->hash = 0;
     msg->size = 0;
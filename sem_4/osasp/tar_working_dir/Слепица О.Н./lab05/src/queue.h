@@ -4,19 +4,24 @@
 #include <time.h>
 #include <stdint.h>
 
+#define MES_DATA_MAX 256
+
+// The payload lives inline, right behind the header.
 typedef struct message
 {
     uint8_t    type;
     uint16_t   hash;
     uint8_t    size;
-    uint8_t*   data;
+    uint8_t    data[];
 } mes_t;
 
+// A node, its message and room for MES_DATA_MAX payload bytes are one pool object.
 typedef struct node 
 {
     mes_t*  message;
     struct node* next;
     struct node* prev;
+    uint64_t enqueued_ns;  // set by bin/bench for latency, unused otherwise
 } node_t;
 
 typedef struct queue
@@ -30,8 +35,15 @@ typedef struct queue
 } queue_t;
 
 void push(node_t**, node_t**);
+void push_node(node_t**, node_t**, node_t*);
 void pop(node_t**, node_t**);
 void init_mes(mes_t*);
+void init_mes_r(mes_t*, uint64_t* seed);
 void print_mes(mes_t*);
 void mes_clear(mes_t*);
 void queue_clear(queue_t*);
+node_t* node_create(void);
+node_t* node_create_r(uint64_t* seed);
+void node_destroy(node_t*);
+void queue_pool_flush(void);
+void queue_pool_destroy(void);
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "ring.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static size_t round_up_pow2(size_t value)
+{
+    size_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+static void futex_wait(atomic_uint* word, unsigned int expected)
+{
+    struct timespec timeout = {0, RING_WAIT_NS};
+    syscall(SYS_futex, (unsigned int*)word, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0);
+}
+
+// Bumps the event word and wakes count sleepers, if anyone registered as waiting.
+static void ring_notify(atomic_uint* seq, atomic_uint* waiters, int count)
+{
+    atomic_fetch_add(seq, 1);
+    if (atomic_load(waiters) > 0)
+        syscall(SYS_futex, (unsigned int*)seq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// A node has left the ring: producers waiting for space look again. Returns the new deleted count.
+static size_t ring_popped(ring_t* ring)
+{
+    ring_notify(&ring->space_seq, &ring->full_waiters, 1);
+    return atomic_fetch_add(&ring->deleted, 1) + 1;
+}
+
+ring_t* ring_create(size_t capacity, size_t limit)
+{
+    size_t size = (sizeof(ring_t) + RING_CACHE_LINE - 1) & ~(size_t)(RING_CACHE_LINE - 1);
+    ring_t* ring = (ring_t*)aligned_alloc(RING_CACHE_LINE, size);
+    if (!ring) {
+        perror("Failed to allocate ring");
+        exit(EXIT_FAILURE);
+    }
+    memset(ring, 0, size);
+
+    ring->capacity = round_up_pow2(capacity < 2 ? 2 : capacity);
+    ring->cells = (ring_cell_t*)calloc(ring->capacity, sizeof(ring_cell_t));
+    if (!ring->cells) {
+        perror("Failed to allocate ring cells");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < ring->capacity; i++)
+        atomic_init(&ring->cells[i].sequence, i);
+    atomic_init(&ring->limit, limit < ring->capacity ? limit : ring->capacity);
+    return ring;
+}
+
+// Frees the ring and the nodes still in it; no thread may use it any more.
+void ring_destroy(ring_t* ring)
+{
+    if (!ring) return;
+
+    node_t* node;
+    while ((node = ring_try_pop(ring)) != NULL)
+        node_destroy(node);
+    free(ring->cells);
+    free(ring);
+}
+
+// Full also means limit nodes in flight; with several producers the limit may be passed by a few.
+bool ring_try_push(ring_t* ring, node_t* node)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ring_cell_t* cell;
+
+    for (;;)
+    {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        if (pos >= head && pos - head >= atomic_load_explicit(&ring->limit, memory_order_relaxed))
+            return false;
+
+        cell = &ring->cells[pos & (ring->capacity - 1)];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->node = node;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+node_t* ring_try_pop(ring_t* ring)
+{
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring_cell_t* cell;
+
+    for (;;)
+    {
+        cell = &ring->cells[pos & (ring->capacity - 1)];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    node_t* node = cell->node;
+    atomic_store_explicit(&cell->sequence, pos + ring->capacity, memory_order_release);
+    return node;
+}
+
+/*
+ * Blocking push: spins RING_SPIN_TRIES times, then sleeps on space_seq.
+ * Returns the new added count, or 0 once *running drops (the node stays
+ * the caller's). running is an atomic_bool so that it can be cleared from
+ * a signal handler or another thread alike.
+ */
+size_t ring_push(ring_t* ring, node_t* node, atomic_bool* running)
+{
+    for (int spin = 0; !ring_try_push(ring, node); spin++)
+    {
+        if (!*running)
+            return 0;
+        if (spin < RING_SPIN_TRIES)
+            continue;
+
+        unsigned int seen = atomic_load(&ring->space_seq);
+        atomic_fetch_add(&ring->full_waiters, 1);
+        if (ring_try_push(ring, node)) {
+            atomic_fetch_sub(&ring->full_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->space_seq, seen);
+        atomic_fetch_sub(&ring->full_waiters, 1);
+    }
+
+    ring_notify(&ring->items_seq, &ring->empty_waiters, 1);
+    return atomic_fetch_add(&ring->added, 1) + 1;
+}
+
+// Blocking pop, the mirror of ring_push(). NULL once *running drops; *deleted gets the new deleted count.
+node_t* ring_pop(ring_t* ring, atomic_bool* running, size_t* deleted)
+{
+    node_t* node;
+
+    for (int spin = 0; (node = ring_try_pop(ring)) == NULL; spin++)
+    {
+        if (!*running)
+            return NULL;
+        if (spin < RING_SPIN_TRIES)
+            continue;
+
+        unsigned int seen = atomic_load(&ring->items_seq);
+        atomic_fetch_add(&ring->empty_waiters, 1);
+        if ((node = ring_try_pop(ring)) != NULL) {
+            atomic_fetch_sub(&ring->empty_waiters, 1);
+            break;
+        }
+        futex_wait(&ring->items_seq, seen);
+        atomic_fetch_sub(&ring->empty_waiters, 1);
+    }
+
+    *deleted = ring_popped(ring);
+    return node;
+}
+
+// ring_pop() that does not wait: NULL when the ring is empty.
+node_t* ring_pop_nowait(ring_t* ring, size_t* deleted)
+{
+    node_t* node = ring_try_pop(ring);
+    if (node != NULL)
+        *deleted = ring_popped(ring);
+    return node;
+}
+
+size_t ring_length(ring_t* ring)
+{
+    size_t tail = atomic_load(&ring->tail);
+    size_t head = atomic_load(&ring->head);
+    return tail > head ? tail - head : 0;
+}
+
+// New size limit from the menu; producers waiting on a full ring get to look again.
+void ring_set_limit(ring_t* ring, size_t limit)
+{
+    atomic_store(&ring->limit, limit < ring->capacity ? limit : ring->capacity);
+    ring_notify(&ring->space_seq, &ring->full_waiters, INT_MAX);
+}
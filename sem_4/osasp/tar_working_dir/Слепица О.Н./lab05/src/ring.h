@@ -0,0 +1,49 @@
+#pragma once
+#include "queue.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define RING_CAPACITY 1024      // cells; the menu's queue size is a limit below this
+#define RING_SPIN_TRIES 100     // failed tries before a thread sleeps on the futex
+#define RING_WAIT_NS 100000000  // futex sleeps are bounded so that a stop flag is seen
+#define RING_CACHE_LINE 64
+
+/*
+ * Bounded MPMC ring of message nodes (Vyukov): a cell is free for
+ * position p when its sequence is p and holds a node for p when it is
+ * p + 1. Producers and consumers take positions with a CAS on tail and
+ * head, each on its own cache line, so there is no lock at all; a thread
+ * only sleeps on a futex word when the ring is full or empty.
+ */
+typedef struct ring_cell
+{
+    atomic_size_t sequence;
+    node_t*       node;
+} ring_cell_t;
+
+typedef struct ring
+{
+    alignas(RING_CACHE_LINE) atomic_size_t tail;
+    alignas(RING_CACHE_LINE) atomic_size_t head;
+    alignas(RING_CACHE_LINE) atomic_uint   items_seq;
+    atomic_uint                            empty_waiters;
+    alignas(RING_CACHE_LINE) atomic_uint   space_seq;
+    atomic_uint                            full_waiters;
+    alignas(RING_CACHE_LINE) atomic_size_t added;
+    atomic_size_t                          deleted;
+    atomic_size_t                          limit;
+    size_t                                 capacity;
+    ring_cell_t*                           cells;
+} ring_t;
+
+ring_t* ring_create(size_t capacity, size_t limit);
+void    ring_destroy(ring_t*);
+bool    ring_try_push(ring_t*, node_t*);
+node_t* ring_try_pop(ring_t*);
+size_t  ring_push(ring_t*, node_t*, atomic_bool* running);
+node_t* ring_pop(ring_t*, atomic_bool* running, size_t* deleted);
+node_t* ring_pop_nowait(ring_t*, size_t* deleted);
+size_t  ring_length(ring_t*);
+void    ring_set_limit(ring_t*, size_t);
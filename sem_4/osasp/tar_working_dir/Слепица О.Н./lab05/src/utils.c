@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 199309L
 #include "utils.h"
 #include "queue.h"
+#include "ring.h"
 
 #include <unistd.h>
 #include <semaphore.h>
@@ -12,12 +13,14 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdio.h>
+#include <string.h>
 
 extern queue_t* queue;
 extern pthread_mutex_t queue_mutex;
 extern pthread_cond_t not_empty;
 extern pthread_cond_t not_full;
-_Thread_local volatile sig_atomic_t thread_continue = 1;
+extern ring_t* ring;
+_Thread_local atomic_bool thread_continue = true;
 
 atomic_int producer_count = 0;
 atomic_int consumer_count = 0;
@@ -25,7 +28,7 @@ atomic_int consumer_count = 0;
 void thread_stop_handler(int signo) 
 {
     if (signo == SIGUSR1) {
-        thread_continue = 0;
+        thread_continue = false;
     }
 }
 
@@ -83,6 +86,7 @@ void* consumer_routine(void* arg)
     sem_close(consumer);
     sem_close(mutex);
 
+    queue_pool_flush();
     printf("\nConsumer %d has finished\n", atomic_fetch_add(&consumer_count, 1) + 1);
     return NULL;
 }
@@ -139,6 +143,7 @@ void* producer_routine(void* arg)
     sem_close(mutex);
 
 
+    queue_pool_flush();
     printf("\nProducer %d has finished\n", atomic_fetch_add(&producer_count, 1) + 1);
     return NULL;
 }
@@ -186,6 +191,7 @@ void* consumer_routine_cond(void* arg)
         sleep(SLEEP_TIME);
     }
 
+    queue_pool_flush();
     printf("\nConsumer %d finished\n", atomic_fetch_add(&consumer_count, 1) + 1);
     return NULL;
 }
@@ -233,6 +239,85 @@ void* producer_routine_cond(void* arg)
         sleep(SLEEP_TIME);
     }
 
+    queue_pool_flush();
     printf("\nProducer %d has finished\n", atomic_fetch_add(&producer_count, 1) + 1);
     return NULL;
 }
+
+void* consumer_routine_ring(void* arg)
+{
+    struct sigaction sa;
+    sa.sa_handler = thread_stop_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    while (thread_continue) 
+    {
+        size_t deleted;
+        node_t* node = ring_pop(ring, &thread_continue, &deleted);
+        if (node == NULL)
+            break;
+
+        // The node is this thread's now, so it is printed without any lock
+        printf("--Ejected %ld message:\n", deleted - 1);
+        print_mes(node->message);
+        node_destroy(node);
+
+        sleep(SLEEP_TIME);
+    }
+
+    queue_pool_flush();
+    printf("\nConsumer %d finished\n", atomic_fetch_add(&consumer_count, 1) + 1);
+    return NULL;
+}
+
+void* producer_routine_ring(void* arg)
+{
+    struct sigaction sa;
+    sa.sa_handler = thread_stop_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    union {
+        mes_t   mes;
+        uint8_t bytes[sizeof(mes_t) + MES_DATA_MAX];
+    } copy;
+
+    while (thread_continue) 
+    {
+        node_t* node = node_create();
+        // Once pushed the node may be popped and freed at any time, so a copy is printed
+        memcpy(&copy, node->message, sizeof(mes_t) + node->message->size);
+
+        size_t added = ring_push(ring, node, &thread_continue);
+        if (added == 0) {
+            node_destroy(node);
+            break;
+        }
+
+        printf("-%ld message:\n", added);
+        print_mes(&copy.mes);
+
+        sleep(SLEEP_TIME);
+    }
+
+    queue_pool_flush();
+    printf("\nProducer %d has finished\n", atomic_fetch_add(&producer_count, 1) + 1);
+    return NULL;
+}
+
+// Menu '-' for the ring: lowers the limit and drops what is over it, counted like a consumer's pop.
+void shrink_ring(size_t limit)
+{
+    ring_set_limit(ring, limit);
+    while (ring_length(ring) > limit)
+    {
+        size_t deleted;
+        node_t* node = ring_pop_nowait(ring, &deleted);
+        if (node == NULL)
+            break;
+        node_destroy(node);
+    }
+}
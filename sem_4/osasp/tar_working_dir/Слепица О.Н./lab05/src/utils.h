@@ -1,6 +1,11 @@
 #pragma once
 
+#include <stddef.h>
+
 void* consumer_routine();
 void* producer_routine();
 void* producer_routine_cond(void* arg);
 void* consumer_routine_cond(void* arg);
+void* producer_routine_ring(void* arg);
+void* consumer_routine_ring(void* arg);
+void shrink_ring(size_t limit);